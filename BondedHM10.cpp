@@ -1,48 +1,129 @@
 #include "BondedHM10.h"
-
-const char *COMMAND_PREFIX = "AT+";
-const char *COMMAND_AT = "AT";
-const char *QUERY = "?";
-const char *AT_RESPONSE = "OK";
-const char *COMMAND_NAME = "NAME";
-const char *NAME_RESPONSE = "OK+NAME:";
-const char *COMMAND_CLEAR = "CLEAR";
-const char *CLEAR_RESPONSE = "OK+CLEAR";
-const char *AT_LOST_RESPONSE = "OK+LOST";
-const char *COMMAND_VERSION = "VERR";
-const char *COMMAND_ADDRESS = "ADDR";
-const char *ADDRESS_RESPONSE = "OK+ADDR:";
-const char *COMMAND_RADD = "RADD";
-const char *RADD_RESPONSE = "OK+RADD:";
-const char *COMMAND_ROLE = "ROLE";
-const char *COMMAND_CON_OUTPUTSTATE_PIN = "AFTC";
-const char *COMMAND_START = "START";
-const char *COMMAND_CONNECT = "CON";
-const char *CONNECT_RESPONSE = "OK+CONN";
-const char *CONNECT_FAILURE_RESPONSE = "OK+CONNF";
-const char *START_RESPONSE = "OK+START";
-const char *COMMAND_WORKTYPE = "IMME";
-const char *COMMAND_BAUDRATE = "BAUD";
-const char *COMMAND_WHITELISTENABLED = "ALLO";
-const char *COMMAND_WHITELIST = "AD";
-const char *WHITELIST_RESPONSE = "OK+AD";
-const char *COMMAND_BONDMODE = "TYPE";
-const char *RESPONSE_OKSET = "OK+Set:";
-const char *RESPONSE_OKGET = "OK+Get:";
-const char *EMPTY_ADDRESS = "000000000000";
-const char *CON_OUTPUTSTATE_PINS = "200";
+#include <EEPROM.h>
+
+// The AT command and response strings are only ever compared with the _P routines, so they stay in flash.
+const char COMMAND_PREFIX[] PROGMEM = "AT+";
+const char COMMAND_AT[] PROGMEM = "AT";
+const char AT_RESPONSE[] PROGMEM = "OK";
+const char COMMAND_CLEAR[] PROGMEM = "CLEAR";
+const char CLEAR_RESPONSE[] PROGMEM = "OK+CLEAR";
+const char AT_LOST_RESPONSE[] PROGMEM = "OK+LOST";
+const char COMMAND_START[] PROGMEM = "START";
+const char COMMAND_CONNECT[] PROGMEM = "CON";
+const char CONNECT_RESPONSE[] PROGMEM = "OK+CONN";
+const char CONNECT_FAILURE_RESPONSE[] PROGMEM = "OK+CONNF";
+const char START_RESPONSE[] PROGMEM = "OK+START";
+const char COMMAND_WHITELIST[] PROGMEM = "AD";
+const char WHITELIST_RESPONSE[] PROGMEM = "OK+AD";
+const char RESPONSE_OKSET[] PROGMEM = "OK+Set:";
+const char EMPTY_ADDRESS[] PROGMEM = "000000000000";
+const char CON_OUTPUTSTATE_PINS[] = "200"; // passed on as a command parameter, which is read from RAM.
 const long DEFAULT_COMMAND_TIMEOUT = 250;
 const long CONNECT_COMMAND_TIMEOUT = 1000;
 const long CONNECTING_COMMAND_TIMEOUT = 10250;
 const uint8_t TRANSIENTCONNECTTEST_RETRYCOUNT = 3;
 const long TRANSIENTCONNECTTEST_DELAY = 500;
 const long DISCONNECTRECONNECT_DEBOUNCE_TIMEOUT = 500;
+const long CONNECT_NOTIFICATION_TIMEOUT = 10;
+
+// The names the debug output prints for each value of a SettingDigit, '\0' separated in value order.
+const char ROLE_NAMES[] PROGMEM = "Peripheral\0Central";
+const char BAUDRATE_NAMES[] PROGMEM = "9600\0" "19200\0" "38400\0" "57600\0" "115200\0" "4800\0" "2400\0" "1200\0" "230400";
+const char WORKTYPE_NAMES[] PROGMEM = "AutoStart\0ManualStart";
+const char ENABLED_NAMES[] PROGMEM = "No\0Yes";
+const char BONDMODE_NAMES[] PROGMEM = "NoAuth\0AuthNoPin\0AuthWithPin\0AuthAndBond";
+
+// The settings read and written by getSetting()/setSetting(). The order must match the SETTING_* indexes below.
+enum SettingType
+{
+  SettingDigit, // a single digit that is also the value of the matching enum.
+  SettingHex,   // exactly maxValue hex digits, which some firmware versions prefix with "0x" when queried.
+  SettingText   // up to maxValue characters.
+};
+
+struct SettingDescriptor
+{
+  char command[5];
+  char response[9]; // what the answer to a query starts with, ahead of the value.
+  uint8_t type;
+  uint8_t maxValue;      // the highest SettingDigit value, or the length of any other value.
+  uint16_t queryTimeout; // milliseconds
+  uint16_t setTimeout;   // milliseconds, 0 when the module doesn't accept writing the setting.
+  uint16_t settleDelay;  // milliseconds to wait before the module accepts the next AT command.
+  const char *valueNames; // SettingDigit only, NULL to print the value as it is.
+};
+
+const SettingDescriptor SETTING_DESCRIPTORS[] PROGMEM = {
+    {"ROLE", "OK+Get:", SettingDigit, BondedHM10::Role::Central, DEFAULT_COMMAND_TIMEOUT, DEFAULT_COMMAND_TIMEOUT, 0, ROLE_NAMES},
+    {"BAUD", "OK+Get:", SettingDigit, BondedHM10::BaudRate::Baud_230400, DEFAULT_COMMAND_TIMEOUT, DEFAULT_COMMAND_TIMEOUT, 0, BAUDRATE_NAMES},
+    {"IMME", "OK+Get:", SettingDigit, BondedHM10::WorkType::ManualStart, DEFAULT_COMMAND_TIMEOUT, DEFAULT_COMMAND_TIMEOUT, 500, WORKTYPE_NAMES}, // The next AT command fails if sent within 0.5 seconds.
+    {"ALLO", "OK+Get:", SettingDigit, 1, DEFAULT_COMMAND_TIMEOUT, DEFAULT_COMMAND_TIMEOUT, 0, ENABLED_NAMES},
+    {"NOTI", "OK+Get:", SettingDigit, 1, DEFAULT_COMMAND_TIMEOUT, DEFAULT_COMMAND_TIMEOUT, 0, ENABLED_NAMES},
+    {"TYPE", "OK+Get:", SettingDigit, BondedHM10::BondMode::AuthAndBond, DEFAULT_COMMAND_TIMEOUT, DEFAULT_COMMAND_TIMEOUT, 0, BONDMODE_NAMES},
+    {"AFTC", "OK+Get:", SettingHex, 3, DEFAULT_COMMAND_TIMEOUT, 2000, 0, NULL},
+    {"NAME", "OK+NAME:", SettingText, 12, DEFAULT_COMMAND_TIMEOUT, DEFAULT_COMMAND_TIMEOUT, 0, NULL},
+    {"ADDR", "OK+ADDR:", SettingText, 12, DEFAULT_COMMAND_TIMEOUT, 0, 0, NULL},
+    {"RADD", "OK+RADD:", SettingText, 12, DEFAULT_COMMAND_TIMEOUT, 0, 0, NULL},
+    {"VERR", "", SettingText, 31, DEFAULT_COMMAND_TIMEOUT, 0, 0, NULL}};
+const uint8_t SETTING_ROLE = 0;
+const uint8_t SETTING_BAUDRATE = 1;
+const uint8_t SETTING_WORKTYPE = 2;
+const uint8_t SETTING_WHITELISTENABLED = 3;
+const uint8_t SETTING_NOTIFICATIONS = 4;
+const uint8_t SETTING_BONDMODE = 5;
+const uint8_t SETTING_OUTPUTSTATEPINS = 6;
+const uint8_t SETTING_NAME = 7;
+const uint8_t SETTING_ADDRESS = 8;
+const uint8_t SETTING_LASTCONNECTEDADDRESS = 9;
+const uint8_t SETTING_FIRMWAREVERSION = 10;
+
 const byte GENERIC_START_BYTE = (byte)'~';
-const char *EVENT_PREFIX = "~EVT";
+const char EVENT_PREFIX[] = "~EVT";
 static const size_t PREFIX_LEN = strlen(EVENT_PREFIX); // EVENT_PREFIX must be the same length as MESSAGE_PREFIX.
-const char *MESSAGE_PREFIX = "~MSG";
-const uint16_t MAX_BYTES_READ_PER_LOOP = 25;
-const uint16_t MAX_CONTENT_BUFFER_SIZE = 256;
+const char MESSAGE_PREFIX[] = "~MSG";
+const uint16_t STREAMING_CHUNK_SIZE = 32;
+const uint16_t FRAGMENT_SIZE = 32;                 // max content bytes sent per fragment of a low priority frame.
+const uint16_t QUEUED_BYTES_PER_PASS = 64;         // max queued content bytes sent per call to loop().
+const uint16_t FRAGMENT_MORE_FLAG = 0x8000;
+const uint16_t FRAGMENT_CONTINUATION_FLAG = 0x4000;
+const uint16_t FRAME_TIMESTAMP_FLAG = 0x2000;
+const uint16_t FRAME_LENGTH_MASK = 0x1FFF;
+const uint16_t CHANNEL_EVENT_ID_BASE = BondedHM10::RESERVED_EVENT_ID_BASE; // + channel number.
+const uint16_t CHANNEL_CREDIT_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x10;
+const uint16_t RPC_REQUEST_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x20;
+const uint16_t RPC_RESPONSE_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x21;
+const uint16_t BLOB_START_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x30;
+const uint16_t BLOB_CHUNK_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x31;
+const uint16_t BLOB_ACK_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x32;
+const uint16_t BLOB_END_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x33;
+const uint16_t BLOB_RESULT_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x34;
+const uint16_t BLOB_CHUNK_SIZE = 64;        // max content bytes sent per chunk of a blob (less if either side can't take that much).
+const uint8_t BLOB_CHUNK_HEADER_SIZE = 4;   // offset of the chunk within the blob.
+const uint8_t BLOB_MAX_TIMEOUTS = 5;        // acknowledgement timeouts in a row before a transfer is given up on.
+const uint8_t BLOB_WINDOW_SIZE = 4;         // chunks that may be sent before waiting for an acknowledgement.
+const unsigned long BLOB_ACK_TIMEOUT = 1000; // milliseconds
+const uint16_t BLOB_CHECKSUM_SEED = 0xFFFF;
+const uint8_t BLOB_OUT_OF_ORDER = 0xFF;
+const uint16_t PING_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x40;
+const uint16_t PONG_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x41;
+const uint16_t CLOCK_SYNC_REQUEST_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x50;
+const uint16_t CLOCK_SYNC_RESPONSE_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x51;
+const unsigned long CLOCK_DRIFT_MIN_SPAN = 10000; // milliseconds between syncs before the drift is estimated.
+const uint16_t HEARTBEAT_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x60;
+const uint16_t HEARTBEAT_ACK_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x61;
+const uint16_t WARM_START_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x70;
+const uint16_t WARM_START_ACK_EVENT_ID = BondedHM10::RESERVED_EVENT_ID_BASE + 0x71;
+const uint8_t PROVISION_PROFILE_VERSION = 2;  // bump whenever provision() starts applying different settings.
+const uint32_t FINGERPRINT_HASH_SEED = 2166136261UL; // FNV-1a offset basis.
+const uint32_t FINGERPRINT_HASH_PRIME = 16777619UL;
+const uint8_t CONFIG_BLOB_VERSION = 1;
+const uint8_t CONFIG_BLOB_WHITELIST_ENABLED_FLAG = 0x01;
+const uint8_t CONFIG_BLOB_NOTIFICATIONS_FLAG = 0x02;
+const char FACTORY_OUTPUT_STATE_PINS[] PROGMEM = "000";
+const char FACTORY_DEVICE_NAME[] PROGMEM = "HMSoft";
+const unsigned long WARM_START_TIMEOUT = 500; // milliseconds to wait on the peripheral to answer the handshake.
+const uint16_t ROUND_TRIP_HISTORY_SIZE = 64; // round trips recorded before the histogram counts are halved.
+const uint16_t ROUND_TRIP_BUCKET_LIMITS[BondedHM10::ROUND_TRIP_BUCKET_COUNT - 1] PROGMEM = {10, 20, 30, 40, 50, 75, 100, 150, 200, 300, 500, 750, 1000, 2000, 5000}; // milliseconds
 const uint16_t TRANSMISSION_TIMER_DURATION = 50;         // milliseconds
 const uint16_t TRANSMISSION_TIMER_DEBOUNCE_TIMEOUT = 50; // milliseconds
 
@@ -50,11 +131,6 @@ BondedHM10 *BondedHM10::_instance = NULL;
 
 BondedHM10::BondedHM10(const Role role, const char *remoteAddress, const byte statePin, const byte resetPin)
 {
-  _responseStr = (char *)calloc(32, sizeof(char));
-  _commandStr = (char *)calloc(32, sizeof(char));
-  _lastConnectedAddressStr = (char *)calloc(13, sizeof(char));
-  _contentBuffer = (uint8_t *)calloc(MAX_CONTENT_BUFFER_SIZE + 1, sizeof(uint8_t));
-
   _role = role;
   _remoteAddress = (char *)remoteAddress;
   _statePin = statePin;
@@ -63,16 +139,83 @@ BondedHM10::BondedHM10(const Role role, const char *remoteAddress, const byte st
   _instance = this;
 }
 
-bool BondedHM10::provision(const BaudRate baudRate)
+BondedHM10::BondedHM10(const Role role, const char *remoteAddress, const byte statePin, const byte resetPin, const uint16_t maxContentLength, const uint8_t receiveBufferCount, uint8_t *receiveBuffers, ReceivedFrame *receivedFrameQueue, uint8_t *printBuffer, const uint16_t printBufferSize, uint8_t *lowPriorityQueueBuffer, uint8_t *offlineQueueBuffer, const uint16_t offlineQueueSize, Channel *channels, uint8_t *channelQueues, const uint16_t channelQueueSize, FeatureState *featureState)
+    : BondedHM10(role, remoteAddress, statePin, resetPin)
+{
+  // All of the buffers and feature state are handed over by BondedHM10T, so nothing is ever allocated. Features
+  // without a buffer (offline queue or channels with a size of 0) fail to enable instead.
+  _staticStorage = true;
+  _maxContentLength = maxContentLength;
+  _contentBufferSize = maxContentLength + 1;
+  _receiveBufferCount = receiveBufferCount;
+  _receivedFrameQueue = receivedFrameQueue;
+
+  for (uint8_t index = 0; index < _receiveBufferCount; index++)
+  {
+    _receiveBuffers[index] = receiveBuffers + (index * _contentBufferSize);
+  }
+
+  _printBuffer = printBuffer;
+  _printBufferSize = printBufferSize;
+  _lowPriorityQueueBuffer = lowPriorityQueueBuffer;
+  _offlineQueueBuffer = offlineQueueBuffer;
+  _offlineQueueSize = offlineQueueSize;
+  _channelQueueSize = channelQueueSize;
+
+  if (channels != NULL)
+  {
+    memset(channels, 0, MAX_CHANNELS * sizeof(Channel));
+    _channels = channels;
+
+    for (uint8_t channel = 0; channel < MAX_CHANNELS; channel++)
+    {
+      _channels[channel].queue = channelQueues + (channel * channelQueueSize);
+    }
+  }
+
+  memset(featureState, 0, sizeof(FeatureState));
+  _deviceConfig = &featureState->deviceConfig;
+  _rpc = &featureState->rpc;
+  _blob = &featureState->blob;
+  _clock = &featureState->clock;
+  _roundTrip = &featureState->roundTrip;
+}
+
+bool BondedHM10::provision(const BaudRate baudRate, const NotificationsMode notificationsMode)
 {
-  setConnectedOutputStatePins(CON_OUTPUTSTATE_PINS);
+  // Every setting is read back first and only written when it differs from the profile, so re-provisioning a module
+  // that's already set up costs nothing but the queries (and no reset).
+  _provisionedSettings = 0;
+  _provisionSkipped = false;
+
+  // With the fingerprint enabled, a module that was already provisioned with this profile is recognized from its
+  // address alone (a single AT+ADDR? query) and the rest of provisioning is skipped.
+  uint8_t fingerprint[PROVISION_FINGERPRINT_SIZE];
+  bool fingerprintAvailable = (_provisionFingerprintEnabled && getProvisionFingerprint(baudRate, notificationsMode, fingerprint));
+
+  if (fingerprintAvailable && isProvisionFingerprintStored(fingerprint))
+  {
+#ifdef DEBUG
+    Serial.println(F("Provisioning fingerprint matches, skipping provisioning."));
+    Serial.flush();
+#endif
+
+    _provisionSkipped = true;
+
+    return true;
+  }
+
+  provisionConnectedOutputStatePins(CON_OUTPUTSTATE_PINS);
 
   BaudRate currentBaudRate;
   if (getBaudRate(currentBaudRate))
   {
     if (currentBaudRate != baudRate)
     {
-      setBaudRate(baudRate);
+      if (setBaudRate(baudRate))
+      {
+        _provisionedSettings |= ConfigBaudRate;
+      }
     }
   }
   else
@@ -91,2076 +234,5088 @@ bool BondedHM10::provision(const BaudRate baudRate)
     success = provision_Peripheral();
   }
 
-  reset();
+  // With notifications on, the module announces connects/disconnects on the UART (OK+CONN/OK+LOST), which is quicker
+  // than waiting on the STATE pin, and is the only way of knowing the connection state when the STATE pin isn't
+  // wired up. Unless asked for, the module's own setting is left alone.
+  if (notificationsMode != KeepNotifications && !provisionNotificationsEnabled(notificationsMode == EnableNotifications))
+  {
+    success = false;
+  }
+
+  if (_provisionedSettings != 0)
+  {
+    reset();
+  }
+
+  if (success && fingerprintAvailable)
+  {
+    storeProvisionFingerprint(fingerprint);
+  }
+
+#ifdef DEBUG
+  Serial.print(F("Provisioned Settings: 0x"));
+  Serial.println(_provisionedSettings, HEX);
+  Serial.flush();
+#endif
 
   return success;
 }
 
-bool BondedHM10::provision_Central()
+uint16_t BondedHM10::getProvisionedSettings()
 {
-  bool success = true;
+  return _provisionedSettings;
+}
+
+bool BondedHM10::getProvisionSkipped()
+{
+  return _provisionSkipped;
+}
 
-  if (!setRole(Role::Central))
+void BondedHM10::setProvisionFingerprintEnabled(const bool enabled, const uint16_t eepromAddress)
+{
+  _provisionFingerprintEnabled = enabled;
+  _provisionFingerprintAddress = eepromAddress;
+}
+
+bool BondedHM10::getProvisionFingerprintEnabled()
+{
+  return _provisionFingerprintEnabled;
+}
+
+void BondedHM10::clearProvisionFingerprint()
+{
+  for (uint8_t i = 0; i < PROVISION_FINGERPRINT_SIZE; i++)
   {
-    success = false;
+    EEPROM.update(_provisionFingerprintAddress + i, 0xFF);
   }
+}
+
+bool BondedHM10::getProvisionFingerprint(const BaudRate baudRate, const NotificationsMode notificationsMode, uint8_t *fingerprint)
+{
+  // The fingerprint is a hash of the profile provision() applies, followed by the module's address packed into 6
+  // bytes, so swapping in another module (or changing the profile) forces a full provisioning.
+  char address[13] = {};
 
-  if (!setWorkType(WorkType::ManualStart))
+  if (!getAddress(address))
   {
-    success = false;
+    return false;
   }
 
-  if (!setWhitelistEnabled(false))
+  uint32_t hash = FINGERPRINT_HASH_SEED;
+
+  hash = updateFingerprintHash(hash, PROVISION_PROFILE_VERSION);
+  hash = updateFingerprintHash(hash, (uint8_t)_role);
+  hash = updateFingerprintHash(hash, (uint8_t)baudRate);
+  hash = updateFingerprintHash(hash, (uint8_t)notificationsMode);
+
+  for (uint8_t i = 0; _remoteAddress[i] != 0; i++)
   {
-    success = false;
+    hash = updateFingerprintHash(hash, (uint8_t)toupper(_remoteAddress[i]));
   }
 
-  if (!setBondMode(BondMode::NoAuth))
+  for (uint8_t i = 0; CON_OUTPUTSTATE_PINS[i] != 0; i++)
   {
-    success = false;
+    hash = updateFingerprintHash(hash, (uint8_t)toupper(CON_OUTPUTSTATE_PINS[i]));
   }
 
-  return success;
+  writeUInt32(fingerprint, hash);
+
+  return packHex(address, fingerprint + 4, 12);
 }
 
-bool BondedHM10::provision_Peripheral()
+bool BondedHM10::isProvisionFingerprintStored(const uint8_t *fingerprint)
 {
-  bool success = true;
+  for (uint8_t i = 0; i < PROVISION_FINGERPRINT_SIZE; i++)
+  {
+    if (EEPROM.read(_provisionFingerprintAddress + i) != fingerprint[i])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
 
-  if (!setRole(Role::Peripheral))
+void BondedHM10::storeProvisionFingerprint(const uint8_t *fingerprint)
+{
+  for (uint8_t i = 0; i < PROVISION_FINGERPRINT_SIZE; i++)
   {
-    success = false;
+    EEPROM.update(_provisionFingerprintAddress + i, fingerprint[i]);
   }
+}
+
+uint32_t BondedHM10::updateFingerprintHash(uint32_t hash, const uint8_t value)
+{
+  return ((hash ^ value) * FINGERPRINT_HASH_PRIME);
+}
+
+bool BondedHM10::packHex(const char *hex, uint8_t *packed, const uint8_t digitCount)
+{
+  // Two digits per byte, most significant first. An odd number of digits gets a leading zero nibble.
+  uint8_t offset = digitCount % 2;
 
-  if (!setWorkType(WorkType::AutoStart))
+  memset(packed, 0, (digitCount + 1) / 2);
+
+  for (uint8_t i = 0; i < digitCount; i++)
   {
-    success = false;
+    char digit = toupper(hex[i]);
+    uint8_t nibble;
+
+    if (digit >= '0' && digit <= '9')
+    {
+      nibble = digit - '0';
+    }
+    else if (digit >= 'A' && digit <= 'F')
+    {
+      nibble = digit - 'A' + 10;
+    }
+    else
+    {
+      return false;
+    }
+
+    uint8_t position = i + offset;
+    packed[position / 2] |= ((position % 2) == 0 ? (nibble << 4) : nibble);
   }
 
-  if (!setWhitelistEnabled(true))
+  return true;
+}
+
+void BondedHM10::unpackHex(const uint8_t *packed, const uint8_t digitCount, char *hex)
+{
+  uint8_t offset = digitCount % 2;
+
+  for (uint8_t i = 0; i < digitCount; i++)
   {
-    success = false;
+    uint8_t position = i + offset;
+    uint8_t nibble = ((position % 2) == 0 ? (packed[position / 2] >> 4) : (packed[position / 2] & 0x0F));
+
+    hex[i] = (nibble < 10 ? ('0' + nibble) : ('A' + nibble - 10));
   }
 
-  if (!setWhitelistAddress(WhitelistSlot::Slot1, _remoteAddress))
+  hex[digitCount] = 0;
+}
+
+bool BondedHM10::saveConfig(uint8_t *blob)
+{
+  // Layout: version, role, baud rate, work type, bond mode, flags, AFTC pins (2 bytes), whitelist slots 1-3 (6 bytes
+  // each) and the device name (12 bytes, zero padded).
+  DeviceConfig config;
+
+  if (!getDeviceConfig(config))
   {
-    success = false;
+    return false;
   }
 
-  if (!setBondMode(BondMode::AuthAndBond))
+  memset(blob, 0, CONFIG_BLOB_SIZE);
+
+  blob[0] = CONFIG_BLOB_VERSION;
+  blob[1] = (uint8_t)config.role;
+  blob[2] = (uint8_t)config.baudRate;
+  blob[3] = (uint8_t)config.workType;
+  blob[4] = (uint8_t)config.bondMode;
+  blob[5] = (config.whitelistEnabled ? CONFIG_BLOB_WHITELIST_ENABLED_FLAG : 0) | (config.notificationsEnabled ? CONFIG_BLOB_NOTIFICATIONS_FLAG : 0);
+
+  bool success = packHex(config.outputStatePins, blob + 6, 3);
+
+  for (uint8_t slot = 0; slot < 3; slot++)
   {
-    success = false;
+    success &= packHex(config.whitelistAddresses[slot], blob + 8 + (slot * 6), 12);
   }
 
+  strncpy((char *)(blob + 26), config.name, 12);
+
   return success;
 }
 
-bool BondedHM10::begin(Stream &serial, bool autoConnect)
+bool BondedHM10::restoreConfig(const uint8_t *blob)
 {
+  if (blob[0] != CONFIG_BLOB_VERSION)
+  {
+#ifdef DEBUG
+    Serial.println(F("restoreConfig failed. Unknown configuration blob version."));
+#endif
+
+    return false;
+  }
+
+  // A replacement module is normally at its factory defaults, so a setting the blob has away from the default is
+  // written straight away rather than read first. Only settings left at the default are read, so they are written
+  // (and the module reset) just when the module has been changed from its defaults.
+  _provisionedSettings = 0;
+
   bool success = true;
+  char str[13];
 
-#ifdef DEBUG
-  Serial.print(F("Initializing bluetooth device "));
+  const Role role = (Role)blob[1];
+  const BaudRate baudRate = (BaudRate)blob[2];
+  const WorkType workType = (WorkType)blob[3];
+  const BondMode bondMode = (BondMode)blob[4];
+  const bool whitelistEnabled = (blob[5] & CONFIG_BLOB_WHITELIST_ENABLED_FLAG) != 0;
+  const bool notificationsEnabled = (blob[5] & CONFIG_BLOB_NOTIFICATIONS_FLAG) != 0;
 
-  if (_role == Role::Central)
+  success &= provisionRole(role, role == Role::Peripheral);
+  success &= provisionBaudRate(baudRate, baudRate == BaudRate::Baud_Default);
+  success &= provisionWorkType(workType, workType == WorkType::AutoStart);
+  success &= provisionBondMode(bondMode, bondMode == BondMode::NoAuth);
+  success &= provisionWhitelistEnabled(whitelistEnabled, !whitelistEnabled);
+  success &= provisionNotificationsEnabled(notificationsEnabled, !notificationsEnabled);
+
+  unpackHex(blob + 6, 3, str);
+  success &= provisionConnectedOutputStatePins(str, strcasecmp_P(str, FACTORY_OUTPUT_STATE_PINS) == 0);
+
+  for (uint8_t slot = WhitelistSlot::Slot1; slot <= WhitelistSlot::Slot3; slot++)
   {
-    Serial.println(F("(central)..."));
+    unpackHex(blob + 8 + ((slot - 1) * 6), 12, str);
+    success &= provisionWhitelistAddress((WhitelistSlot)slot, str, strcasecmp_P(str, EMPTY_ADDRESS) == 0);
   }
-  else
+
+  memcpy(str, blob + 26, 12);
+  str[12] = 0;
+
+  if (str[0] != 0)
   {
-    Serial.println(F("(peripheral)..."));
+    success &= provisionDeviceName(str, strcmp_P(str, FACTORY_DEVICE_NAME) == 0);
   }
 
-  Serial.flush();
-#endif
+  if (_provisionedSettings != 0)
+  {
+    // The module no longer holds the profile provision() applied, so don't let a stored fingerprint skip it.
+    if (_provisionFingerprintEnabled)
+    {
+      clearProvisionFingerprint();
+    }
 
-  _stream = &serial;
+    reset();
+  }
 
-  pinMode(_statePin, INPUT);
+  return success;
+}
 
-  pinMode(_resetPin, OUTPUT);
-  digitalWrite(_resetPin, HIGH);
-  delay(250); // Need to wait a little bit after setting the reset pin HIGH.
+bool BondedHM10::provision_Central()
+{
+  bool success = true;
 
-  if (_role == Role::Central)
+  if (!provisionRole(Role::Central))
   {
-    success = begin_Central(autoConnect);
+    success = false;
   }
-  else
+
+  if (!provisionWorkType(WorkType::ManualStart))
   {
-    success = begin_Peripheral(autoConnect);
+    success = false;
   }
 
-#ifdef DEBUG
-  if (success)
+  if (!provisionWhitelistEnabled(false))
   {
-    Serial.println(F("Bluetooth device initialized."));
+    success = false;
   }
-  else
+
+  if (!provisionBondMode(BondMode::NoAuth))
   {
-    Serial.println(F("Bluetooth device initialization FAILED."));
+    success = false;
   }
-#endif
-
-  _initialized = success;
 
   return success;
 }
 
-bool BondedHM10::begin_Central(bool autoConnect)
+bool BondedHM10::provision_Peripheral()
 {
-  bool success = false;
-
-  // In order to ACCURATELY detect if there is an active connection at "initialization time", we need to account for the posibility
-  // of the central device being in a transient "connected" state. This can happen if the central device is shutdown (i.e. the host
-  // device is turned off or loses power, etc.) without having first disconnected from its peripherals, and while a connection to
-  // the peripheral device(s) is unavailable the central is powered back on. If the central device is set to start work immediately
-  // when powered on (via the AT+IMME1 command), it will automatically attempt to reconnect to the last connected peripheral (that is,
-  // if the central is configured to save it's last connected address via the AT+SAVE command) This creates a situation where the
-  // central device may have already successfully reconnected to the peripheral before the "initBluetooth" function can is executed.
-  // Once the central device has connected to a peripheral, the central's module parameters can only be configured via AT commands
-  // transmitted over UART from the peripheral (and ONLY if the "remote control" work mode is enabled on the central device, via the
-  // AT+MODE2 command). Any attempt to execute AT commands on the central device while it is connected to a peripheral will result in
-  // those commands being transmitted as text to the peripheral over UART. This also means the AT+CLEAR command, and any other AT
-  // command that might tell the central device to disconnect or to disable the reconnection attempts, will simply NOT work. The best
-  // way to work around the transient "connected" state is to test for an active connection multiple times with a short delay between
-  // each test. If all of the tests yield a positive "connected" state, then we can be fairly certain the central device is actively
-  // connected to a peripheral.
+  bool success = true;
 
-  if (isConnected(true))
+  if (!provisionRole(Role::Peripheral))
   {
-    Serial.println(F("Previous active connection detected. Disconnecting..."));
-
-    bool disconnectSuccessful = disconnect();
-
-#ifdef DEBUG
-    if (!disconnectSuccessful)
-    {
-      Serial.println(F("Disconnect FAILED."));
-    }
-#endif
-
-    if (!disconnectSuccessful)
-    {
-      return false;
-    }
+    success = false;
   }
 
-  success = sendCommandWithExpectedResponse("", false, NULL, AT_RESPONSE, _responseStr); // AT (test)
+  if (!provisionWorkType(WorkType::AutoStart))
+  {
+    success = false;
+  }
 
-  if (success)
+  if (!provisionWhitelistEnabled(true))
   {
-    if (getLastConnectedAddress(_lastConnectedAddressStr))
-    {
-      if (strcmp(_lastConnectedAddressStr, _remoteAddress) != 0 && strcmp(_lastConnectedAddressStr, EMPTY_ADDRESS) != 0)
-      {
-#ifdef DEBUG
-        Serial.println(F("Clearing the last connected peripheral address since it does NOT match the hardcoded peripheral address."));
-#endif
+    success = false;
+  }
 
-        success = clearLastConnectedAddress();
-      }
-    }
-    else
-    {
-      success = false;
-    }
+  if (!provisionWhitelistAddress(WhitelistSlot::Slot1, _remoteAddress))
+  {
+    success = false;
   }
 
-  if (success)
+  if (!provisionBondMode(BondMode::AuthAndBond))
   {
-    if (autoConnect)
-    {
-      reconnectToPeripheral();
-      _lastConnectAttemptTimestamp = millis();
-    }
+    success = false;
   }
 
   return success;
 }
 
-bool BondedHM10::begin_Peripheral(bool autoConnect)
+bool BondedHM10::provisionRole(const Role role, const bool readFirst)
 {
-  bool success = true;
+  Role currentRole;
+  if (readFirst && getRole(currentRole) && (currentRole == role))
+  {
+    return true;
+  }
 
-  if (success)
+  if (!setRole(role))
   {
-    if (autoConnect)
-    {
-      _lastConnectAttemptTimestamp = millis();
-    }
+    return false;
   }
 
-  return success;
-}
+  _provisionedSettings |= ConfigRole;
 
-bool BondedHM10::ready()
-{
-  return _initialized;
+  return true;
 }
 
-void BondedHM10::resetPrefixDetection()
+bool BondedHM10::provisionWorkType(const WorkType workType, const bool readFirst)
+{
+  WorkType currentWorkType;
+  if (readFirst && getWorkType(currentWorkType) && (currentWorkType == workType))
+  {
+    return true;
+  }
+
+  if (!setWorkType(workType))
+  {
+    return false;
+  }
+
+  _provisionedSettings |= ConfigWorkType;
+
+  return true;
+}
+
+bool BondedHM10::provisionWhitelistEnabled(const bool enabled, const bool readFirst)
+{
+  bool currentEnabled;
+  if (readFirst && getWhitelistEnabled(currentEnabled) && (currentEnabled == enabled))
+  {
+    return true;
+  }
+
+  if (!setWhitelistEnabled(enabled))
+  {
+    return false;
+  }
+
+  _provisionedSettings |= ConfigWhitelistEnabled;
+
+  return true;
+}
+
+bool BondedHM10::provisionWhitelistAddress(const WhitelistSlot slot, const char *address, const bool readFirst)
+{
+  char currentAddress[13] = {};
+  if (readFirst && getWhitelistAddress(slot, currentAddress) && (strcasecmp(currentAddress, address) == 0))
+  {
+    return true;
+  }
+
+  if (!setWhitelistAddress(slot, address))
+  {
+    return false;
+  }
+
+  _provisionedSettings |= whitelistField(slot);
+
+  return true;
+}
+
+bool BondedHM10::provisionBondMode(const BondMode bondMode, const bool readFirst)
+{
+  BondMode currentBondMode;
+  if (readFirst && getBondMode(currentBondMode) && (currentBondMode == bondMode))
+  {
+    return true;
+  }
+
+  if (!setBondMode(bondMode))
+  {
+    return false;
+  }
+
+  _provisionedSettings |= ConfigBondMode;
+
+  return true;
+}
+
+bool BondedHM10::provisionConnectedOutputStatePins(const char *pinHex, const bool readFirst)
+{
+  char currentPinHex[4] = {};
+  if (readFirst && getConnectedOutputStatePins(currentPinHex) && (strcasecmp(currentPinHex, pinHex) == 0))
+  {
+    return true;
+  }
+
+  if (!setConnectedOutputStatePins(pinHex))
+  {
+    return false;
+  }
+
+  _provisionedSettings |= ConfigOutputStatePins;
+
+  return true;
+}
+
+bool BondedHM10::provisionDeviceName(const char *deviceName, const bool readFirst)
+{
+  char currentDeviceName[sizeof(DeviceConfig::name)] = {};
+  if (readFirst && getDeviceName(currentDeviceName) && (strcmp(currentDeviceName, deviceName) == 0))
+  {
+    return true;
+  }
+
+  if (!setDeviceName(deviceName))
+  {
+    return false;
+  }
+
+  _provisionedSettings |= ConfigName;
+
+  return true;
+}
+
+bool BondedHM10::provisionBaudRate(const BaudRate baudRate, const bool readFirst)
+{
+  BaudRate currentBaudRate;
+  if (readFirst && getBaudRate(currentBaudRate) && (currentBaudRate == baudRate))
+  {
+    return true;
+  }
+
+  if (!setBaudRate(baudRate))
+  {
+    return false;
+  }
+
+  _provisionedSettings |= ConfigBaudRate;
+
+  return true;
+}
+
+bool BondedHM10::provisionNotificationsEnabled(const bool enabled, const bool readFirst)
+{
+  bool currentEnabled;
+  if (readFirst && getNotificationsEnabled(currentEnabled) && (currentEnabled == enabled))
+  {
+    return true;
+  }
+
+  if (!setNotificationsEnabled(enabled))
+  {
+    return false;
+  }
+
+  _provisionedSettings |= ConfigNotificationsEnabled;
+
+  return true;
+}
+
+bool BondedHM10::begin(Stream &serial, bool autoConnect)
+{
+  bool success = true;
+
+#ifdef DEBUG
+  Serial.print(F("Initializing bluetooth device "));
+
+  if (_role == Role::Central)
+  {
+    Serial.println(F("(central)..."));
+  }
+  else
+  {
+    Serial.println(F("(peripheral)..."));
+  }
+
+  Serial.flush();
+#endif
+
+  _stream = &serial;
+
+  if (!allocateContentBuffer(_streamingReceiveEnabled))
+  {
+    return false;
+  }
+
+  if (_statePin >= 0)
+  {
+    pinMode(_statePin, INPUT);
+  }
+
+  pinMode(_resetPin, OUTPUT);
+  digitalWrite(_resetPin, HIGH);
+  delay(250); // Need to wait a little bit after setting the reset pin HIGH.
+
+  if (_role == Role::Central)
+  {
+    success = begin_Central(autoConnect);
+  }
+  else
+  {
+    success = begin_Peripheral(autoConnect);
+  }
+
+#ifdef DEBUG
+  if (success)
+  {
+    Serial.println(F("Bluetooth device initialized."));
+  }
+  else
+  {
+    Serial.println(F("Bluetooth device initialization FAILED."));
+  }
+#endif
+
+  _initialized = success;
+
+  return success;
+}
+
+bool BondedHM10::begin_Central(bool autoConnect)
+{
+  bool success = false;
+
+  // In order to ACCURATELY detect if there is an active connection at "initialization time", we need to account for the posibility
+  // of the central device being in a transient "connected" state. This can happen if the central device is shutdown (i.e. the host
+  // device is turned off or loses power, etc.) without having first disconnected from its peripherals, and while a connection to
+  // the peripheral device(s) is unavailable the central is powered back on. If the central device is set to start work immediately
+  // when powered on (via the AT+IMME1 command), it will automatically attempt to reconnect to the last connected peripheral (that is,
+  // if the central is configured to save it's last connected address via the AT+SAVE command) This creates a situation where the
+  // central device may have already successfully reconnected to the peripheral before the "initBluetooth" function can is executed.
+  // Once the central device has connected to a peripheral, the central's module parameters can only be configured via AT commands
+  // transmitted over UART from the peripheral (and ONLY if the "remote control" work mode is enabled on the central device, via the
+  // AT+MODE2 command). Any attempt to execute AT commands on the central device while it is connected to a peripheral will result in
+  // those commands being transmitted as text to the peripheral over UART. This also means the AT+CLEAR command, and any other AT
+  // command that might tell the central device to disconnect or to disable the reconnection attempts, will simply NOT work. The best
+  // way to work around the transient "connected" state is to test for an active connection multiple times with a short delay between
+  // each test. If all of the tests yield a positive "connected" state, then we can be fairly certain the central device is actively
+  // connected to a peripheral.
+
+  if (isConnected(true))
+  {
+    if (_warmStartEnabled && adoptExistingConnection())
+    {
+      // The link is already up with the right peripheral, so it is kept as is and picked up by the first call to
+      // loop(). AT commands can't be sent to the module until the next disconnect (they would be sent to the
+      // peripheral as data), so the usual checks below are skipped.
+#ifdef DEBUG
+      Serial.println(F("Previous active connection detected. Keeping it (warm start)."));
+#endif
+
+      return true;
+    }
+
+    Serial.println(F("Previous active connection detected. Disconnecting..."));
+
+    bool disconnectSuccessful = disconnect();
+
+#ifdef DEBUG
+    if (!disconnectSuccessful)
+    {
+      Serial.println(F("Disconnect FAILED."));
+    }
+#endif
+
+    if (!disconnectSuccessful)
+    {
+      return false;
+    }
+  }
+
+  success = sendCommandWithExpectedResponse(NULL, false, NULL, AT_RESPONSE, _responseStr); // AT (test)
+
+  if (success)
+  {
+    if (getLastConnectedAddress(_lastConnectedAddressStr))
+    {
+      if (strcmp(_lastConnectedAddressStr, _remoteAddress) != 0 && strcmp_P(_lastConnectedAddressStr, EMPTY_ADDRESS) != 0)
+      {
+#ifdef DEBUG
+        Serial.println(F("Clearing the last connected peripheral address since it does NOT match the hardcoded peripheral address."));
+#endif
+
+        success = clearLastConnectedAddress();
+      }
+    }
+    else
+    {
+      success = false;
+    }
+  }
+
+  if (success)
+  {
+    if (autoConnect)
+    {
+      reconnectToPeripheral();
+      _lastConnectAttemptTimestamp = millis();
+    }
+  }
+
+  return success;
+}
+
+bool BondedHM10::adoptExistingConnection()
+{
+  // Make sure the module really is connected to a BondedHM10 peripheral that is up and running, by sending it a
+  // handshake it answers straight from its receive path.
+  uint8_t nonce[4];
+  unsigned long startTime = millis();
+
+  _warmStartNonce = micros();
+  _warmStartAcknowledged = false;
+  writeUInt32(nonce, _warmStartNonce);
+
+  writeFrameHeader(true, WARM_START_EVENT_ID, 4);
+  _stream->write(nonce, 4);
+
+  while (!_warmStartAcknowledged && (millis() - startTime) < WARM_START_TIMEOUT)
+  {
+    if (_stream->available() > 0)
+    {
+      processIncomingByte((byte)_stream->read());
+    }
+  }
+
+  if (_warmStartAcknowledged)
+  {
+    _moduleConnected = true;
+  }
+  else
+  {
+    resetPrefixDetection();
+    resetEventParsing();
+  }
+
+  return _warmStartAcknowledged;
+}
+
+void BondedHM10::setWarmStartEnabled(const bool enabled)
+{
+  _warmStartEnabled = enabled;
+}
+
+bool BondedHM10::getWarmStartEnabled()
+{
+  return _warmStartEnabled;
+}
+
+bool BondedHM10::begin_Peripheral(bool autoConnect)
+{
+  bool success = true;
+
+  if (success)
+  {
+    if (autoConnect)
+    {
+      _lastConnectAttemptTimestamp = millis();
+    }
+  }
+
+  return success;
+}
+
+bool BondedHM10::ready()
+{
+  return _initialized;
+}
+
+void BondedHM10::resetPrefixDetection()
 {
   _prefixCursor = 0;
   _messageSuspected = false;
   _eventSuspected = false;
 }
 
-void BondedHM10::resetContentParsing()
+void BondedHM10::resetContentParsing()
+{
+  _lengthLowByte = 0;
+  _lengthHighByte = 0;
+  _headerCursor = 0;
+  _contentCursor = 0;
+  _chunkCursor = 0;
+  _contentLength = 0;
+  _contentOffset = 0;
+  _moreFragments = false;
+  _continuationFragment = false;
+  _messageDetected = false;
+  _eventDetected = false;
+  _discardingFrame = false;
+}
+
+void BondedHM10::resetEventParsing()
+{
+  _eventIDLowByte = 0;
+  _eventIDHighByte = 0;
+  _eventID = 0;
+  _frameTimestamped = false;
+  resetContentParsing();
+}
+
+void BondedHM10::loop(uint16_t maxBytesToRead)
+{
+  if (_initialized)
+  {
+    serviceConnection();
+
+    if (_connected && _consoleModeEnabled)
+    {
+      if (Serial)
+      {
+        // TODO: Add while loops here to do the reads/writes in larger batches.
+        // This will also help with support for flashing an LED on communication.
+
+        if (_stream->available())
+        {
+          if (_dataTransmittedOutputPin >= 0)
+          {
+            startTransmissionTimer();
+          }
+
+          Serial.write(_stream->read());
+        }
+
+        if (Serial.available())
+        {
+          if (_dataTransmittedOutputPin >= 0)
+          {
+            startTransmissionTimer();
+          }
+
+          _stream->write(Serial.read());
+        }
+      }
+    }
+    else
+    {
+      // available() is only asked once per pass, leaving a single virtual call per byte read.
+      byte bytes[MAX_BYTES_READ_PER_LOOP];
+      int available = _stream->available();
+      uint16_t count = min(available, (int)MAX_BYTES_READ_PER_LOOP);
+
+      for (uint16_t i = 0; i < count; i++)
+      {
+        bytes[i] = (byte)_stream->read();
+      }
+
+      receiveBytes(bytes, count);
+    }
+
+    serviceLink();
+  }
+}
+
+void BondedHM10::serviceConnection()
+{
+  detectAndHandleConnection();
+
+  if (_role == Role::Central)
+  {
+    detectAndHandleDisconnectReconnect();
+  }
+}
+
+void BondedHM10::receiveBytes(const byte *bytes, const uint16_t count)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  if (_connected)
+  {
+    _lastReceiveTime = millis(); // Any data from the remote shows that the link is alive.
+    _heartbeatMisses = 0;
+
+    if (_dataTransmittedOutputPin >= 0)
+    {
+      startTransmissionTimer();
+    }
+  }
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+#ifdef DEBUG
+#ifdef VERBOSE
+    Serial.println((char)bytes[i]);
+#endif
+#endif
+
+    // While disconnected only the module's own notifications (OK+CONN/OK+LOST) arrive. Once connected, the byte
+    // following an OK+CONN notification may already be part of the first frame.
+    processIncomingByte(bytes[i]);
+  }
+}
+
+void BondedHM10::serviceLink()
+{
+  if (_connected && !_consoleModeEnabled)
+  {
+    if (_streamingReceiveEnabled && _chunkCursor > 0)
+    {
+      // Hand over whatever content has arrived so far instead of waiting for the chunk buffer to fill up.
+      deliverFrameChunk();
+    }
+
+    drainTransmitQueues();
+    serviceChannels();
+    checkRpcTimeouts();
+    serviceBlobTransfer();
+
+    if (_pingInterval > 0 && _connected && (millis() - _lastPingTime) >= _pingInterval)
+    {
+      ping();
+    }
+
+    if (_clockSyncInterval > 0 && _connected && (millis() - _lastClockSyncRequestTime) >= _clockSyncInterval)
+    {
+      syncClock();
+    }
+
+    if (_heartbeatInterval > 0 && _connected)
+    {
+      checkHeartbeat();
+    }
+  }
+
+  if (_connectNotificationPending && (millis() - _connectNotificationTimestamp) >= CONNECT_NOTIFICATION_TIMEOUT)
+  {
+    // Nothing followed the OK+CONN, so it wasn't the start of an OK+CONNA/OK+CONNE/OK+CONNF response.
+    _connectNotificationPending = false;
+    onConnectNotification();
+  }
+}
+
+bool BondedHM10::isReceivingFrames()
+{
+  return (_initialized && !_consoleModeEnabled);
+}
+
+Stream *BondedHM10::getStream()
+{
+  return _stream;
+}
+
+void BondedHM10::processNotificationByte(const byte currentByte)
+{
+  if (_connectNotificationPending)
+  {
+    // OK+CONN is also the start of the OK+CONNA (connecting), OK+CONNE (error) and OK+CONNF (failed) responses,
+    // so it only counts as a connect notification when something else follows it.
+    _connectNotificationPending = false;
+
+    if (currentByte == 'A' || currentByte == 'E' || currentByte == 'F')
+    {
+      return;
+    }
+
+    onConnectNotification();
+  }
+
+  // Both notifications share the same "OK+" start, and are told apart by the character after it.
+  const char *notification = (_notificationCursor > 3 && _lostNotificationSuspected ? AT_LOST_RESPONSE : CONNECT_RESPONSE);
+
+  if (_notificationCursor == 3 && currentByte == pgm_read_byte(&AT_LOST_RESPONSE[3]))
+  {
+    _lostNotificationSuspected = true;
+    notification = AT_LOST_RESPONSE;
+  }
+  else if (_notificationCursor == 3)
+  {
+    _lostNotificationSuspected = false;
+  }
+
+  if (currentByte != pgm_read_byte(&notification[_notificationCursor]))
+  {
+    _notificationCursor = (currentByte == pgm_read_byte(&CONNECT_RESPONSE[0]) ? 1 : 0);
+    return;
+  }
+
+  _notificationCursor++;
+
+  if (pgm_read_byte(&notification[_notificationCursor]) != 0)
+  {
+    return;
+  }
+
+  _notificationCursor = 0;
+
+  if (notification == AT_LOST_RESPONSE)
+  {
+#ifdef DEBUG
+    Serial.println(F("OK+LOST notification received."));
+#endif
+
+    _moduleConnected = false;
+    _lostNotificationPending = true;
+
+    if (_connected)
+    {
+      _connectionStateChangeTimestamp = millis();
+      onDisconnect();
+    }
+  }
+  else
+  {
+    _connectNotificationPending = true;
+    _connectNotificationTimestamp = millis();
+  }
+}
+
+void BondedHM10::onConnectNotification()
+{
+#ifdef DEBUG
+  Serial.println(F("OK+CONN notification received."));
+#endif
+
+  _moduleConnected = true;
+  _lostNotificationPending = false;
+
+  if (!_connected)
+  {
+    _connectionStateChangeTimestamp = _connectNotificationTimestamp;
+    onConnect();
+  }
+}
+
+void BondedHM10::processIncomingByte(const byte currentByte)
+{
+  if (!_eventDetected && !_messageDetected)
+  {
+    processNotificationByte(currentByte);
+  }
+
+  if (_eventDetected || _messageDetected)
+  {
+    // Once a prefix has been detected every byte belongs to the frame until its full length has been read, so
+    // binary content (or a length/ID) that happens to contain the GENERIC_START_BYTE doesn't restart the parsing.
+    processFrameByte(currentByte);
+  }
+  else if (currentByte == GENERIC_START_BYTE)
+  {
+#ifdef DEBUG
+#ifdef VERBOSE
+    Serial.println(F("Prefix suspected."));
+#endif
+#endif
+
+    _prefixCursor = 1; // Move the prefix cursor to the next position.
+    resetEventParsing();
+  }
+  else if (_prefixCursor > 0)
+  {
+    if (currentByte == MESSAGE_PREFIX[_prefixCursor])
+    {
+      if (_prefixCursor == 1 || _messageSuspected)
+      {
+#ifdef DEBUG
+#ifdef VERBOSE
+        if (!_messageSuspected)
+        {
+          Serial.println(F("Message prefix suspected."));
+        }
+#endif
+#endif
+
+        _messageSuspected = true;
+        _prefixCursor++;
+      }
+      else
+      {
+        resetPrefixDetection();
+      }
+    }
+    else if (currentByte == EVENT_PREFIX[_prefixCursor])
+    {
+      if (_prefixCursor == 1 || _eventSuspected)
+      {
+#ifdef DEBUG
+#ifdef VERBOSE
+        if (!_eventSuspected)
+        {
+          Serial.println(F("Event prefix suspected."));
+        }
+#endif
+#endif
+
+        _eventSuspected = true;
+        _prefixCursor++;
+      }
+      else
+      {
+        resetPrefixDetection();
+      }
+    }
+    else
+    {
+      resetPrefixDetection();
+    }
+
+    // Determine if we've read the full event/message prefix.
+    if (_prefixCursor == PREFIX_LEN)
+    {
+      if (_messageSuspected)
+      {
+#ifdef DEBUG
+#ifdef VERBOSE
+        Serial.println(F("Message detected."));
+#endif
+#endif
+
+        _messageDetected = true;
+      }
+      else if (_eventSuspected)
+      {
+#ifdef DEBUG
+#ifdef VERBOSE
+        Serial.println(F("Event detected."));
+#endif
+#endif
+
+        _eventDetected = true;
+      }
+
+      resetPrefixDetection();
+    }
+  }
+}
+
+void BondedHM10::processFrameByte(const byte currentByte)
+{
+  // Events have a 4 byte header (2 bytes for the Event ID + 2 bytes for the length). Messages only have the 2 byte length.
+  // Either can be followed by a 4 byte timestamp, which is flagged in the length.
+  const uint8_t lengthEnd = (_eventDetected ? 4 : 2);
+  const uint8_t headerLen = lengthEnd + (_frameTimestamped ? 4 : 0);
+
+  if (_headerCursor < headerLen)
+  {
+    if (_eventDetected && _headerCursor == 0)
+    {
+      _eventIDLowByte = currentByte;
+    }
+    else if (_eventDetected && _headerCursor == 1)
+    {
+      _eventIDHighByte = currentByte;
+      _eventID = (uint16_t)word(_eventIDHighByte, _eventIDLowByte);
+
+#ifdef DEBUG
+#ifdef VERBOSE
+      Serial.print(F("Event ID detected: "));
+      Serial.println(_eventID);
+#endif
+#endif
+    }
+    else if (_headerCursor == lengthEnd - 2)
+    {
+      _lengthLowByte = currentByte;
+    }
+    else if (_headerCursor == lengthEnd - 1)
+    {
+      _lengthHighByte = currentByte;
+      _frameTimestamped = ((_lengthHighByte & highByte(FRAME_TIMESTAMP_FLAG)) != 0);
+      _frameTimestamp = 0;
+    }
+    else
+    {
+      _frameTimestamp |= ((unsigned long)currentByte << (8 * (_headerCursor - lengthEnd)));
+    }
+
+    if (_headerCursor == (lengthEnd + (_frameTimestamped ? 4 : 0) - 1))
+    {
+      processFrameLength((uint16_t)word(_lengthHighByte, _lengthLowByte));
+
+      if (_contentLength < 1)
+      {
+        resetEventParsing();
+        return;
+      }
+    }
+
+    _headerCursor++;
+    return;
+  }
+
+  if (_discardingFrame)
+  {
+    // Skip the content of a dropped frame.
+  }
+  else if (_streamingFrame)
+  {
+    _contentBuffer[_chunkCursor++] = (uint8_t)currentByte;
+
+    if (_chunkCursor == STREAMING_CHUNK_SIZE)
+    {
+      deliverFrameChunk();
+    }
+  }
+  else
+  {
+    _contentBuffer[_contentOffset + _contentCursor] = (uint8_t)currentByte;
+  }
+
+  _contentCursor++;
+
+  if (_contentCursor == _contentLength)
+  {
+    if (_discardingFrame)
+    {
+      // Nothing to hand over.
+    }
+    else if (_moreFragments)
+    {
+      // Wait for the rest of the fragments before handing the frame over.
+      _assemblyLength += _contentLength;
+
+      if (_streamingFrame)
+      {
+        deliverFrameChunk();
+      }
+    }
+    else if (_streamingFrame)
+    {
+      deliverFrameChunk();
+      _assembling = false;
+
+      if (_frameEndHandler)
+      {
+        _frameEndHandler();
+      }
+    }
+    else
+    {
+      uint8_t bufferIndex = _receiveBufferIndex;
+      uint16_t length = _contentLength;
+
+      if (_continuationFragment)
+      {
+        bufferIndex = _assemblyBufferIndex;
+        length = _assemblyLength + _contentLength;
+
+        _receiveBufferRetainCounts[_assemblyBufferIndex]--;
+        _assembling = false;
+      }
+
+      _receiveBuffers[bufferIndex][length] = 0; // Null terminate for the char handlers.
+
+      if (_eventDetected && isControlEvent(_eventID))
+      {
+        // Control events are handled straight away, so they never take up a place in the deferred queue (or wait
+        // behind frames that do).
+        handleControlEvent(_eventID, _receiveBuffers[bufferIndex], length);
+      }
+      else if (!_deferredDispatchEnabled)
+      {
+        dispatchReceivedFrame(_eventDetected, _eventID, _receiveBuffers[bufferIndex], length);
+      }
+      else if (hasSpareReceiveBuffer(bufferIndex))
+      {
+        queueReceivedFrame(_eventDetected, _eventID, bufferIndex, length);
+      }
+      else
+      {
+#ifdef DEBUG
+        Serial.println(F("Deferred dispatch queue full. Frame dropped."));
+#endif
+
+        dropReceivedFrame(_eventDetected, _eventID);
+      }
+    }
+
+    resetEventParsing();
+  }
+}
+
+void BondedHM10::processFrameLength(const uint16_t lengthField)
+{
+  // Frames sent at a low priority are split into fragments so that high priority frames can be sent in between
+  // them. The top two bits of the length tell whether more fragments follow, and whether this fragment continues
+  // a frame whose first fragment has already been received.
+  _moreFragments = ((lengthField & FRAGMENT_MORE_FLAG) != 0);
+  _continuationFragment = ((lengthField & FRAGMENT_CONTINUATION_FLAG) != 0);
+  _contentLength = (lengthField & FRAME_LENGTH_MASK);
+  _contentOffset = 0;
+  _receivedFrameTimestamp = _frameTimestamp;
+
+  // Events reserved for the library's own use are always buffered whole (even in streaming mode, where they get one
+  // of the full size receive buffers), since they are handled by the library rather than being passed on to the
+  // frame handlers.
+  _streamingFrame = _streamingReceiveEnabled && !(_eventDetected && _eventID >= RESERVED_EVENT_ID_BASE);
+
+  if (_contentLength < 1)
+  {
+#ifdef DEBUG
+#ifdef VERBOSE
+    Serial.print(F("Invalid content length detected: "));
+    Serial.println(_contentLength);
+#endif
+#endif
+
+    return;
+  }
+
+#ifdef DEBUG
+#ifdef VERBOSE
+  Serial.print(F("Length detected: "));
+  Serial.println(_contentLength);
+#endif
+#endif
+
+  if (_continuationFragment)
+  {
+    if (!_assembling || _assemblyIsEvent != _eventDetected || _assemblyID != _eventID)
+    {
+      // The start of the frame this fragment belongs to was never received (or was abandoned).
+      dropReceivedFrame(_eventDetected, _eventID);
+      _discardingFrame = true;
+    }
+    else if (!_streamingFrame)
+    {
+      if ((_assemblyLength + _contentLength) > (getReceiveBufferSize(_assemblyBufferIndex) - 1))
+      {
+        abandonFragmentAssembly();
+        dropReceivedFrame(_eventDetected, _eventID);
+        _discardingFrame = true;
+      }
+      else
+      {
+        _contentBuffer = _receiveBuffers[_assemblyBufferIndex];
+        _contentOffset = _assemblyLength;
+      }
+    }
+
+    return;
+  }
+
+  if (_moreFragments)
+  {
+    // A new fragmented frame replaces any unfinished one.
+    abandonFragmentAssembly();
+  }
+
+  if (!_streamingFrame && _contentLength > _maxContentLength)
+  {
+    dropReceivedFrame(_eventDetected, _eventID);
+    _discardingFrame = true;
+  }
+  else if (!selectReceiveBuffer(_streamingFrame ? STREAMING_CHUNK_SIZE : _contentLength))
+  {
+    // Every receive buffer is still being held by the application, so there is nowhere to put the content.
+    // The rest of the frame is still read (to stay in sync with the stream), but is thrown away.
+#ifdef DEBUG
+    Serial.println(F("No free receive buffer available. Frame dropped."));
+#endif
+
+    dropReceivedFrame(_eventDetected, _eventID);
+    _discardingFrame = true;
+  }
+  else if (_moreFragments && !_streamingFrame && !hasSpareReceiveBuffer(_receiveBufferIndex))
+  {
+    // Holding on to the last free buffer for the rest of the fragments would leave nowhere to receive the frames
+    // sent in between them.
+    dropReceivedFrame(_eventDetected, _eventID);
+    _discardingFrame = true;
+  }
+  else
+  {
+    if (_moreFragments)
+    {
+      _assembling = true;
+      _assemblyIsEvent = _eventDetected;
+      _assemblyID = _eventID;
+      _assemblyLength = 0;
+      _assemblyBufferIndex = _receiveBufferIndex;
+
+      if (!_streamingReceiveEnabled)
+      {
+        _receiveBufferRetainCounts[_assemblyBufferIndex]++; // Keep the parser from reusing the buffer for frames sent in between the fragments.
+      }
+    }
+
+    if (_streamingFrame && _frameStartHandler)
+    {
+      // The total length of a fragmented frame isn't known up front, so 0 is reported for it.
+      _frameStartHandler(_eventDetected, _eventID, (_moreFragments ? 0 : _contentLength));
+    }
+  }
+}
+
+void BondedHM10::abandonFragmentAssembly()
+{
+  if (_assembling && !_streamingReceiveEnabled)
+  {
+    _receiveBufferRetainCounts[_assemblyBufferIndex]--;
+  }
+
+  _assembling = false;
+  _assemblyLength = 0;
+}
+
+void BondedHM10::deliverFrameChunk()
+{
+  if (_chunkCursor == 0)
+  {
+    return;
+  }
+
+  _contentBuffer[_chunkCursor] = 0;
+
+  if (_frameChunkHandler)
+  {
+    _frameChunkHandler(_contentBuffer, _chunkCursor);
+  }
+
+  _chunkCursor = 0;
+}
+
+void BondedHM10::dropReceivedFrame(const bool isEvent, const uint16_t id)
+{
+  _droppedFrameCount++;
+
+  if (isEvent && id >= CHANNEL_EVENT_ID_BASE && id < (CHANNEL_EVENT_ID_BASE + MAX_CHANNELS))
+  {
+    returnChannelCredit(id - CHANNEL_EVENT_ID_BASE);
+  }
+}
+
+void BondedHM10::dispatchReceivedFrame(const bool isEvent, const uint16_t id, uint8_t *content, const uint16_t length)
+{
+  unsigned long startTime = micros();
+
+  if (isEvent && id >= RESERVED_EVENT_ID_BASE)
+  {
+    // Channel data, RPC calls and blob chunks end up in application handlers as well, so they are dispatched (and
+    // timed) like any other event.
+    dispatchReservedEvent(id, content, length);
+    updateHandlerMetrics(_eventHandlerMetrics, micros() - startTime);
+  }
+  else if (isEvent)
+  {
+#ifdef DEBUG
+#ifdef VERBOSE
+    Serial.print(F("Event received:"));
+    Serial.println((char *)content);
+#endif
+#endif
+
+    if (_eventReceivedUInt8Handler)
+    {
+      _eventReceivedUInt8Handler(id, content, length);
+    }
+
+    if (_eventReceivedCharHandler)
+    {
+      _eventReceivedCharHandler(id, (char *)content, length);
+    }
+
+    updateHandlerMetrics(_eventHandlerMetrics, micros() - startTime);
+  }
+  else
+  {
+#ifdef DEBUG
+#ifdef VERBOSE
+    Serial.print(F("Message received:"));
+    Serial.println((char *)content);
+#endif
+#endif
+
+    if (_messageReceivedUInt8Handler)
+    {
+      _messageReceivedUInt8Handler(content, length);
+    }
+
+    if (_messageReceivedCharHandler)
+    {
+      _messageReceivedCharHandler((char *)content, length);
+    }
+
+    updateHandlerMetrics(_messageHandlerMetrics, micros() - startTime);
+  }
+}
+
+void BondedHM10::updateHandlerMetrics(HandlerMetrics &metrics, const unsigned long elapsed)
+{
+  metrics.invocations++;
+  metrics.totalMicros += elapsed;
+
+  if (elapsed > metrics.maxMicros)
+  {
+    metrics.maxMicros = elapsed;
+  }
+
+  if (elapsed >= _slowHandlerThreshold)
+  {
+    metrics.slowInvocations++;
+
+#ifdef DEBUG
+    Serial.print(F("WARNING: Slow received handler ("));
+    Serial.print(elapsed);
+    Serial.println(F(" microseconds)."));
+#endif
+  }
+}
+
+void BondedHM10::queueReceivedFrame(const bool isEvent, const uint16_t id, const uint8_t bufferIndex, const uint16_t length)
+{
+  // The frame keeps its receive buffer retained while it waits in the queue, so the parser moves on to the next
+  // free buffer. Since each queued frame holds a buffer of its own, the queue can never hold more frames than
+  // there are receive buffers.
+  uint8_t tail = (_receivedFrameQueueHead + _receivedFrameQueueCount) % _receiveBufferCount;
+  ReceivedFrame &frame = _receivedFrameQueue[tail];
+
+  frame.bufferIndex = bufferIndex;
+  frame.isEvent = isEvent;
+  frame.id = id;
+  frame.length = length;
+  frame.timestamp = _frameTimestamp;
+
+  _receiveBufferRetainCounts[bufferIndex]++;
+  _receivedFrameQueueCount++;
+}
+
+uint8_t BondedHM10::dispatch(const unsigned long budget)
+{
+  unsigned long startTime = micros();
+  uint8_t dispatchedCount = 0;
+
+  // At least one frame is always dispatched so that progress is made even when a single handler exceeds the budget.
+  while (_receivedFrameQueueCount > 0)
+  {
+    ReceivedFrame frame = _receivedFrameQueue[_receivedFrameQueueHead];
+
+    _receivedFrameQueueHead = (_receivedFrameQueueHead + 1) % _receiveBufferCount;
+    _receivedFrameQueueCount--;
+
+    _receivedFrameTimestamp = frame.timestamp;
+    dispatchReceivedFrame(frame.isEvent, frame.id, _receiveBuffers[frame.bufferIndex], frame.length);
+    _receiveBufferRetainCounts[frame.bufferIndex]--;
+    dispatchedCount++;
+
+    if (budget > 0 && (micros() - startTime) >= budget)
+    {
+      break;
+    }
+  }
+
+  return dispatchedCount;
+}
+
+bool BondedHM10::setReceiveBufferCount(const uint8_t count)
+{
+  // The buffers are laid out (and the deferred queue sized) from the count, so it can only be changed before any of
+  // them have been allocated.
+  if (count < 2 || count > MAX_RECEIVE_BUFFER_COUNT || _initialized || _staticStorage || _receivedFrameQueue != NULL)
+  {
+    return false;
+  }
+
+  _receiveBufferCount = count;
+
+  return true;
+}
+
+uint8_t BondedHM10::getReceiveBufferCount()
+{
+  return _receiveBufferCount;
+}
+
+bool BondedHM10::setDeferredDispatchEnabled(const bool enabled)
+{
+  if (enabled && _receivedFrameQueue == NULL)
+  {
+    // One entry per receive buffer, since each queued frame holds on to a buffer of its own.
+    _receivedFrameQueue = (ReceivedFrame *)allocate(_receiveBufferCount, sizeof(ReceivedFrame));
+
+    if (_receivedFrameQueue == NULL)
+    {
+      return false;
+    }
+  }
+
+  _deferredDispatchEnabled = enabled;
+
+  return true;
+}
+
+bool BondedHM10::getDeferredDispatchEnabled()
+{
+  return _deferredDispatchEnabled;
+}
+
+uint8_t BondedHM10::getPendingFrameCount()
+{
+  return _receivedFrameQueueCount;
+}
+
+unsigned long BondedHM10::getSlowHandlerThreshold()
+{
+  return _slowHandlerThreshold;
+}
+
+void BondedHM10::setSlowHandlerThreshold(const unsigned long threshold)
+{
+  _slowHandlerThreshold = threshold;
+}
+
+void BondedHM10::getMessageHandlerMetrics(HandlerMetrics &metrics)
+{
+  metrics = _messageHandlerMetrics;
+}
+
+void BondedHM10::getEventHandlerMetrics(HandlerMetrics &metrics)
+{
+  metrics = _eventHandlerMetrics;
+}
+
+void BondedHM10::resetHandlerMetrics()
+{
+  memset(&_messageHandlerMetrics, 0, sizeof(HandlerMetrics));
+  memset(&_eventHandlerMetrics, 0, sizeof(HandlerMetrics));
+}
+
+bool BondedHM10::setStreamingReceiveEnabled(const bool enabled)
+{
+  if (enabled == _streamingReceiveEnabled)
+  {
+    return true;
+  }
+
+  // Buffers still held by the application, or waiting to be dispatched, must not be freed or handed to the other
+  // mode. The only hold that is dropped by the switch is the one on an unfinished fragmented frame.
+  if (_receivedFrameQueueCount > 0)
+  {
+    return false;
+  }
+
+  for (uint8_t index = 0; index < _receiveBufferCount; index++)
+  {
+    uint8_t retainCount = _receiveBufferRetainCounts[index];
+
+    if (_assembling && !_streamingReceiveEnabled && index == _assemblyBufferIndex)
+    {
+      retainCount--;
+    }
+
+    if (retainCount > 0)
+    {
+      return false;
+    }
+  }
+
+  if (!enabled && _receiveBuffers[0] != NULL && _contentBufferSize < (_maxContentLength + 1))
+  {
+    // The small chunk buffer allocated for streaming can't hold a whole frame, so swap it for a full size one. The
+    // old buffer is only released once the new one has been allocated.
+    uint8_t *buffer = (uint8_t *)allocate(_maxContentLength + 1, sizeof(uint8_t));
+
+    if (buffer == NULL)
+    {
+      return false;
+    }
+
+    free(_receiveBuffers[0]);
+    _receiveBuffers[0] = buffer;
+    _contentBufferSize = _maxContentLength + 1;
+    _receiveBufferIndex = 0;
+    _contentBuffer = buffer;
+  }
+
+  abandonFragmentAssembly();
+  _streamingReceiveEnabled = enabled;
+  resetEventParsing();
+
+  return true;
+}
+
+bool BondedHM10::getStreamingReceiveEnabled()
+{
+  return _streamingReceiveEnabled;
+}
+
+void BondedHM10::setFrameStartHandler(FrameStartDelegate frameStartHandler)
+{
+  _frameStartHandler = frameStartHandler;
+}
+
+void BondedHM10::setFrameChunkHandler(FrameChunkDelegate frameChunkHandler)
+{
+  _frameChunkHandler = frameChunkHandler;
+}
+
+void BondedHM10::setFrameEndHandler(FrameEndDelegate frameEndHandler)
+{
+  _frameEndHandler = frameEndHandler;
+}
+
+void *BondedHM10::allocate(const size_t count, const size_t size)
+{
+  // Every buffer the library allocates goes through here, so getAllocationCount() can be watched for allocations
+  // a sketch doesn't expect. Buffers are allocated the first time their feature is used, and only turning streaming
+  // receive back off replaces one.
+  if (_staticStorage)
+  {
+    return NULL;
+  }
+
+  _allocationCount++;
+
+  return calloc(count, size);
+}
+
+uint16_t BondedHM10::getAllocationCount()
+{
+  return _allocationCount;
+}
+
+// The state of each optional feature is allocated the first time the feature is used, and then kept.
+bool BondedHM10::allocateDeviceConfig()
+{
+  if (_deviceConfig == NULL)
+  {
+    _deviceConfig = (DeviceConfig *)allocate(1, sizeof(DeviceConfig));
+  }
+
+  return (_deviceConfig != NULL);
+}
+
+bool BondedHM10::allocateChannels()
+{
+  if (_channels == NULL)
+  {
+    _channels = (Channel *)allocate(MAX_CHANNELS, sizeof(Channel));
+  }
+
+  return (_channels != NULL);
+}
+
+bool BondedHM10::allocateRpcState()
+{
+  if (_rpc == NULL)
+  {
+    _rpc = (RpcState *)allocate(1, sizeof(RpcState));
+  }
+
+  return (_rpc != NULL);
+}
+
+bool BondedHM10::allocateBlobState()
+{
+  if (_blob == NULL)
+  {
+    _blob = (BlobState *)allocate(1, sizeof(BlobState));
+  }
+
+  return (_blob != NULL);
+}
+
+bool BondedHM10::allocateClockState()
+{
+  if (_clock == NULL)
+  {
+    _clock = (ClockState *)allocate(1, sizeof(ClockState));
+  }
+
+  return (_clock != NULL);
+}
+
+bool BondedHM10::allocateRoundTripState()
+{
+  if (_roundTrip == NULL)
+  {
+    _roundTrip = (RoundTripState *)allocate(1, sizeof(RoundTripState));
+  }
+
+  return (_roundTrip != NULL);
+}
+
+bool BondedHM10::allocateContentBuffer(const bool streaming)
+{
+  if (_receiveBuffers[0] == NULL)
+  {
+    // In streaming mode content is handed over in chunks, so only a single chunk needs to be buffered. The library's
+    // own events are still received whole, into one of the other (full size) buffers.
+    _contentBufferSize = (streaming ? STREAMING_CHUNK_SIZE : _maxContentLength) + 1;
+    _receiveBuffers[0] = (uint8_t *)allocate(_contentBufferSize, sizeof(uint8_t));
+  }
+
+  _receiveBufferIndex = 0;
+  _contentBuffer = _receiveBuffers[0];
+
+  return (_contentBuffer != NULL);
+}
+
+bool BondedHM10::hasSpareReceiveBuffer(const uint8_t heldIndex)
+{
+  // One receive buffer is always left free (allocated or not), so that the library's own events and the next frame
+  // can still be received while the others are being held on to.
+  for (uint8_t index = 0; index < _receiveBufferCount; index++)
+  {
+    if (index != heldIndex && _receiveBufferRetainCounts[index] == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint16_t BondedHM10::getReceiveBufferSize(const uint8_t index)
+{
+  // Only the first buffer can be smaller, when it was allocated for streaming mode.
+  return (index == 0 ? _contentBufferSize : _maxContentLength + 1);
+}
+
+bool BondedHM10::selectReceiveBuffer(const uint16_t length)
+{
+  // Keep using the buffer the last frame was received into, unless the application is still holding on to it or the
+  // content won't fit.
+  if (_receiveBufferRetainCounts[_receiveBufferIndex] == 0 && length < getReceiveBufferSize(_receiveBufferIndex))
+  {
+    _contentBuffer = _receiveBuffers[_receiveBufferIndex];
+    return true;
+  }
+
+  uint8_t index = 0;
+
+  for (index = 0; index < _receiveBufferCount; index++)
+  {
+    if (_receiveBuffers[index] != NULL && _receiveBufferRetainCounts[index] == 0 && length < getReceiveBufferSize(index))
+    {
+      break;
+    }
+  }
+
+  if (index == _receiveBufferCount)
+  {
+    // The additional buffers are only allocated the first time they are needed, so sketches that never
+    // retain content don't pay for them.
+    for (index = 0; index < _receiveBufferCount; index++)
+    {
+      if (_receiveBuffers[index] == NULL)
+      {
+        _receiveBuffers[index] = (uint8_t *)allocate(_maxContentLength + 1, sizeof(uint8_t));
+        break;
+      }
+    }
+
+    if (index == _receiveBufferCount || _receiveBuffers[index] == NULL)
+    {
+      return false;
+    }
+  }
+
+  _receiveBufferIndex = index;
+  _contentBuffer = _receiveBuffers[index];
+
+  return true;
+}
+
+int8_t BondedHM10::getReceiveBufferIndex(const uint8_t *content)
+{
+  if (content != NULL)
+  {
+    for (uint8_t index = 0; index < _receiveBufferCount; index++)
+    {
+      if (_receiveBuffers[index] == content)
+      {
+        return index;
+      }
+    }
+  }
+
+  return -1;
+}
+
+bool BondedHM10::retainContent(const uint8_t *content)
+{
+  int8_t index = getReceiveBufferIndex(content);
+
+  if (index < 0 || _receiveBufferRetainCounts[index] == 255)
+  {
+    return false;
+  }
+
+  if (_receiveBufferRetainCounts[index] == 0 && !hasSpareReceiveBuffer(index))
+  {
+    return false;
+  }
+
+  _receiveBufferRetainCounts[index]++;
+
+  return true;
+}
+
+bool BondedHM10::retainContent(const char *content)
+{
+  return retainContent((const uint8_t *)content);
+}
+
+void BondedHM10::releaseContent(const uint8_t *content)
+{
+  int8_t index = getReceiveBufferIndex(content);
+
+  if (index >= 0 && _receiveBufferRetainCounts[index] > 0)
+  {
+    _receiveBufferRetainCounts[index]--;
+  }
+}
+
+void BondedHM10::releaseContent(const char *content)
+{
+  releaseContent((const uint8_t *)content);
+}
+
+uint32_t BondedHM10::getDroppedFrameCount()
+{
+  return _droppedFrameCount;
+}
+
+void BondedHM10::setConsoleModeEnabled(const bool consoleModeEnabled)
+{
+  _consoleModeEnabled = consoleModeEnabled;
+}
+
+bool BondedHM10::getConsoleModeEnabled()
+{
+  return _consoleModeEnabled;
+}
+
+byte BondedHM10::getConnectedOutputPin()
+{
+  return _connectedOutputPin;
+}
+
+void BondedHM10::setConnectedOutputPin(const byte connectedOutputPin)
+{
+  if (connectedOutputPin < 0)
+  {
+    clearConnectedOutputPin();
+  }
+  else
+  {
+    _connectedOutputPin = connectedOutputPin;
+  }
+}
+
+void BondedHM10::clearConnectedOutputPin()
+{
+  digitalWrite(_connectedOutputPin, LOW);
+  _connectedOutputPin = -1;
+}
+
+byte BondedHM10::getDataTransmittedOutputPin()
+{
+  return _dataTransmittedOutputPin;
+}
+
+void BondedHM10::setDataTransmittedOutputPin(const byte dataTransmittedOutputPin)
+{
+  if (dataTransmittedOutputPin < 0)
+  {
+    clearDataTransmittedOutputPin();
+  }
+  else
+  {
+    _dataTransmittedOutputPin = dataTransmittedOutputPin;
+  }
+}
+
+void BondedHM10::clearDataTransmittedOutputPin()
+{
+  digitalWrite(_dataTransmittedOutputPin, LOW);
+  _dataTransmittedOutputPin = -1;
+  stopTransmissionTimer();
+}
+
+void BondedHM10::setConnectedHandler(ConnectedDelegate connectedHandler)
+{
+  _connectedHandler = connectedHandler;
+}
+
+void BondedHM10::setDisconnectedHandler(DisconnectedDelegate disconnectedHandler)
+{
+  _disconnectedHandler = disconnectedHandler;
+}
+
+byte BondedHM10::getDisconnectReconnectInputPin()
+{
+  return _disconnectReconnectInputPin;
+}
+
+void BondedHM10::setDisconnectReconnectInputPin(const byte disconnectReconnectInputPin)
+{
+  _disconnectReconnectInputPin = disconnectReconnectInputPin;
+}
+
+void BondedHM10::clearDisconnectReconnectInputPin()
+{
+  _disconnectReconnectInputPin = -1;
+}
+
+bool BondedHM10::getAutoReconnectEnabled()
+{
+  return _autoReconnectEnabled;
+}
+
+void BondedHM10::setAutoReconnectEnabled(const bool enabled)
+{
+  _autoReconnectEnabled = enabled;
+}
+
+long BondedHM10::getAutoReconnectTimeout()
+{
+  return _autoReconnectTimeout;
+}
+
+void BondedHM10::setAutoReconnectTimeout(const unsigned long timeout)
+{
+  _autoReconnectTimeout = timeout;
+}
+
+void BondedHM10::setReconnectBackoff(const unsigned long initialDelay, const unsigned long maxDelay, const uint8_t jitterPercent)
+{
+  // An initial delay of 0 turns the backoff off, going back to retrying every auto-reconnect timeout.
+  _reconnectBackoffEnabled = (initialDelay > 0);
+  _reconnectInitialDelay = initialDelay;
+  _reconnectMaxDelay = max(initialDelay, maxDelay);
+  _reconnectJitterPercent = min(jitterPercent, 100);
+  _reconnectDelay = initialDelay;
+  _reconnectJitter = 0;
+}
+
+unsigned long BondedHM10::getReconnectDelay()
+{
+  return (_reconnectBackoffEnabled ? _reconnectDelay : (unsigned long)_autoReconnectTimeout);
+}
+
+unsigned long BondedHM10::getJitteredReconnectDelay()
+{
+  if (!_reconnectBackoffEnabled)
+  {
+    return (unsigned long)_autoReconnectTimeout;
+  }
+
+  // The jitter is kept apart from the delay, so it doesn't build up from one attempt to the next, and the delay
+  // actually waited stays within the configured range.
+  long jitteredDelay = (long)_reconnectDelay + _reconnectJitter;
+
+  return (unsigned long)constrain(jitteredDelay, (long)_reconnectInitialDelay, (long)_reconnectMaxDelay);
+}
+
+void BondedHM10::getReconnectStats(ReconnectStats &stats)
+{
+  stats = _reconnectStats;
+  stats.currentDelay = getReconnectDelay();
+}
+
+void BondedHM10::resetReconnectStats()
+{
+  memset(&_reconnectStats, 0, sizeof(ReconnectStats));
+}
+
+void BondedHM10::recordReconnectAttempt(const bool connected, const unsigned long duration)
+{
+  _reconnectStats.attempts++;
+  _reconnectStats.lastAttemptDuration = duration;
+
+  if (duration > _reconnectStats.longestAttemptDuration)
+  {
+    _reconnectStats.longestAttemptDuration = duration;
+  }
+
+  if (connected)
+  {
+    _reconnectDelay = _reconnectInitialDelay;
+    _reconnectJitter = 0;
+    return;
+  }
+
+  _reconnectStats.failures++;
+
+  if (_reconnectBackoffEnabled)
+  {
+    // Double the delay after every failed attempt (up to the max), so a short outage is recovered from quickly
+    // while a remote that is gone for good isn't tried every few seconds. The jitter keeps the attempts from
+    // falling into step with whatever is making them fail.
+    _reconnectDelay = min(_reconnectDelay * 2, _reconnectMaxDelay);
+
+    long jitterRange = (long)(_reconnectDelay / 100) * _reconnectJitterPercent;
+
+    _reconnectJitter = (jitterRange > 0 ? random(-jitterRange, jitterRange + 1) : 0);
+  }
+}
+
+bool BondedHM10::isConnected(bool testForTransientConnection)
+{
+  if (_statePin < 0)
+  {
+    // Without the STATE pin wired up, the module's OK+CONN/OK+LOST notifications are all there is to go on.
+    return _moduleConnected;
+  }
+
+  if (_lostNotificationPending)
+  {
+    // The STATE pin can lag behind an OK+LOST notification, so it isn't trusted again until it has caught up.
+    if (readStatePin())
+    {
+      return false;
+    }
+
+    _lostNotificationPending = false;
+  }
+
+  if (!testForTransientConnection)
+  {
+    return readStatePin();
+  }
+  else
+  {
+    byte testIndex = 0;
+
+    while (testIndex < TRANSIENTCONNECTTEST_RETRYCOUNT)
+    {
+      if (!readStatePin())
+      {
+#ifdef DEBUG
+#ifdef VERBOSE
+        Serial.println(F("STATE pin on chip reads LOW (connection NOT active)."));
+#endif
+#endif
+
+        return false;
+      }
+      else
+      {
+#ifdef DEBUG
+#ifdef VERBOSE
+        Serial.println(F("STATE pin on chip reads HIGH (connection active)."));
+#endif
+#endif
+      }
+
+      delay(TRANSIENTCONNECTTEST_DELAY);
+      testIndex++;
+    }
+
+    return true;
+  }
+}
+
+bool BondedHM10::isConnected()
+{
+  return isConnected(false);
+}
+
+bool BondedHM10::readStatePin()
+{
+  if (_statePinInterruptEnabled)
+  {
+    // Kept up to date by the pin change interrupt, so there's no need to read the pin.
+    return _statePinHigh;
+  }
+
+  return (digitalRead(_statePin) == HIGH);
+}
+
+bool BondedHM10::setStatePinInterruptEnabled(const bool enabled)
+{
+  if (_statePin < 0 || digitalPinToInterrupt(_statePin) == NOT_AN_INTERRUPT)
+  {
+#ifdef DEBUG
+    Serial.println(F("The STATE pin does not support interrupts."));
+#endif
+
+    return false;
+  }
+
+  if (enabled)
+  {
+    _statePinHigh = (digitalRead(_statePin) == HIGH);
+    _statePinChangeTimestamp = millis();
+    attachInterrupt(digitalPinToInterrupt(_statePin), handleStatePinInterrupt, CHANGE);
+  }
+  else
+  {
+    detachInterrupt(digitalPinToInterrupt(_statePin));
+  }
+
+  _statePinInterruptEnabled = enabled;
+
+  return true;
+}
+
+bool BondedHM10::isStatePinInterruptEnabled()
+{
+  return _statePinInterruptEnabled;
+}
+
+unsigned long BondedHM10::getConnectionStateChangeTimestamp()
+{
+  return _connectionStateChangeTimestamp;
+}
+
+unsigned long BondedHM10::getStatePinChangeTimestamp()
+{
+  if (!_statePinInterruptEnabled)
+  {
+    return millis();
+  }
+
+  // The timestamp is written by the interrupt, so it is copied with interrupts off to keep it from changing part
+  // way through the (multi-byte) read.
+  noInterrupts();
+  unsigned long timestamp = _statePinChangeTimestamp;
+  interrupts();
+
+  return timestamp;
+}
+
+void BondedHM10::handleStatePinInterrupt()
+{
+  _instance->_statePinHigh = (digitalRead(_instance->_statePin) == HIGH);
+  _instance->_statePinChangeTimestamp = millis();
+}
+
+bool BondedHM10::disconnect()
+{
+  if (_initialized && (_role == Role::Central) && _connected)
+  {
+    reset();
+    detectAndHandleConnection();
+
+    bool success = false;
+
+    if (!isConnected(true))
+    {
+      success = true;
+    }
+
+#ifdef DEBUG
+    if (success)
+    {
+      Serial.println(F("Disconnected."));
+    }
+    else
+    {
+      Serial.println(F("Disconnect FAILED."));
+    }
+
+    Serial.flush();
+#endif
+
+    return success;
+  }
+  else
+  {
+    return false;
+  }
+}
+
+bool BondedHM10::startWork()
+{
+  bool success = sendCommandWithExpectedResponse(COMMAND_START, false, NULL, START_RESPONSE, _responseStr);
+
+#ifdef DEBUG
+  Serial.print(F("START WORK"));
+
+  if (!success)
+  {
+    Serial.print(F(": FAILURE: "));
+    Serial.println(_responseStr);
+  }
+  else
+  {
+    Serial.println();
+  }
+
+  Serial.flush();
+#endif
+
+  return success;
+}
+
+bool BondedHM10::connectToPeripheral()
+{
+  if (_role != Role::Central)
+  {
+    return false;
+  }
+
+  if (_connecting)
+  {
+#ifdef DEBUG
+    Serial.println(F("connectToPeripheral exited early. Connecting in progress..."));
+#endif
+
+    return false;
+  }
+
+#ifdef DEBUG
+  Serial.print(F("Attempting to connect to peripheral at "));
+  Serial.print(_remoteAddress);
+  Serial.println(F("..."));
+#endif
+
+  _connecting = true;
+  bool success = sendCommandWithExpectedResponse(COMMAND_CONNECT, false, _remoteAddress, CONNECT_RESPONSE, _responseStr, CONNECT_COMMAND_TIMEOUT);
+
+  if (success)
+  {
+    // The single character after OK+CONN tells how the connect went (A = attempting, E = error, F = failed).
+    char responseCode = _responseStr[strlen_P(CONNECT_RESPONSE)];
+
+    if (responseCode == 'A')
+    {
+      if (waitForResponse(CONNECT_FAILURE_RESPONSE, _responseStr, CONNECTING_COMMAND_TIMEOUT))
+      {
+        // We received at AT+CONNF response (failure).
+        if (isConnected())
+        {
+          success = true;
+
+#ifdef DEBUG
+          Serial.println(F("SUCCESS: Already connected."));
+#endif
+        }
+        else
+        {
+          success = false;
+
+#ifdef DEBUG
+          Serial.println(F("FAILURE: Peripheral unavailable."));
+#endif
+        }
+      }
+      else
+      {
+        if (strncmp_P(_responseStr, CONNECT_RESPONSE, strlen_P(CONNECT_RESPONSE)) == 0)
+        {
+          // The OK+CONN notification was read as part of the response, so the parser will never see it.
+          _moduleConnected = true;
+        }
+
+        if (isConnected())
+        {
+          success = true;
+
+#ifdef DEBUG
+          Serial.println(F("SUCCESS: Connected."));
+#endif
+        }
+        else
+        {
+          success = false;
+
+#ifdef DEBUG
+          Serial.println(F("FAILURE: Peripheral unavailable."));
+#endif
+        }
+      }
+    }
+    else if (responseCode == 'E')
+    {
+      success = false;
+
+#ifdef DEBUG
+      Serial.println(F("FAILURE: Connect Error."));
+#endif
+    }
+    else if (responseCode == 'F')
+    {
+      success = false;
+
+#ifdef DEBUG
+      Serial.println(F("FAILURE: Peripheral unavailable."));
+#endif
+    }
+    else if (responseCode == 0)
+    {
+      success = true;
+
+#ifdef DEBUG
+      Serial.println(F("SUCCESS: Already connected."));
+#endif
+    }
+    else
+    {
+      success = false;
+
+#ifdef DEBUG
+      Serial.print(F("FAILURE: Unknown response code: "));
+      Serial.println(responseCode);
+#endif
+    }
+  }
+  else
+  {
+#ifdef DEBUG
+    Serial.println(F("FAILURE: Reason unknown."));
+#endif
+  }
+
+  _connecting = false;
+
+  return success;
+}
+
+bool BondedHM10::reconnectToPeripheral()
+{
+  if (_connecting)
+  {
+#ifdef DEBUG
+    Serial.println(F("reconnectToPeripheral exited early. Connecting in progress..."));
+#endif
+
+    return false;
+  }
+
+  bool success = startWork();
+
+  if (success)
+  {
+    // Get the last connected address. If we think it's a valid address, then just call startWork to auto connect to the
+    // peripheral. If it is not a valid address, then attempt to manually connect to the hardcoded peripheral address.
+    if (getCachedLastConnectedAddress())
+    {
+      if (strcmp_P(_lastConnectedAddressStr, EMPTY_ADDRESS) == 0)
+      {
+        success = connectToPeripheral();
+      }
+      else
+      {
+        _connecting = true;
+      }
+    }
+  }
+
+  return success;
+}
+
+void BondedHM10::reset()
+{
+  _moduleConnected = false;
+  invalidateDeviceConfig(); // Settings changed since the last reset only take effect now.
+
+  digitalWrite(_resetPin, LOW);
+  delay(101); // Hold the RESET pin LOW for at least 100 miliseconds to trigger a reset of the bluetooth device.
+  digitalWrite(_resetPin, HIGH);
+
+  delay(250);
+}
+
+bool BondedHM10::setConnectedOutputStatePins(const char *pinHex)
+{
+  _deviceConfigValidFields &= ~ConfigOutputStatePins;
+
+  return setSetting(SETTING_OUTPUTSTATEPINS, pinHex);
+}
+
+bool BondedHM10::getConnectedOutputStatePins(char *pinHex)
+{
+  if (isDeviceConfigFieldValid(ConfigOutputStatePins))
+  {
+    strcpy(pinHex, _deviceConfig->outputStatePins);
+    return true;
+  }
+
+  bool success = getSetting(SETTING_OUTPUTSTATEPINS, pinHex);
+
+  if (success && allocateDeviceConfig())
+  {
+    strcpy(_deviceConfig->outputStatePins, pinHex);
+    _deviceConfigValidFields |= ConfigOutputStatePins;
+  }
+
+  return success;
+}
+
+bool BondedHM10::getDeviceName(char *deviceName)
+{
+  if (isDeviceConfigFieldValid(ConfigName))
+  {
+    strcpy(deviceName, _deviceConfig->name);
+    return true;
+  }
+
+  bool success = getSetting(SETTING_NAME, deviceName);
+
+  if (success && allocateDeviceConfig())
+  {
+    strcpy(_deviceConfig->name, deviceName);
+    _deviceConfigValidFields |= ConfigName;
+  }
+
+  return success;
+}
+
+bool BondedHM10::setDeviceName(const char *deviceName)
+{
+  _deviceConfigValidFields &= ~ConfigName;
+
+  return setSetting(SETTING_NAME, deviceName);
+}
+
+bool BondedHM10::getAddress(char *address)
+{
+  if (isDeviceConfigFieldValid(ConfigAddress))
+  {
+    strcpy(address, _deviceConfig->address);
+    return true;
+  }
+
+  bool success = getSetting(SETTING_ADDRESS, address);
+
+  if (success && allocateDeviceConfig())
+  {
+    strcpy(_deviceConfig->address, address);
+    _deviceConfigValidFields |= ConfigAddress;
+  }
+
+  return success;
+}
+
+bool BondedHM10::getFirmwareVersion(char *versionStr)
+{
+  if (isDeviceConfigFieldValid(ConfigFirmwareVersion))
+  {
+    strcpy(versionStr, _deviceConfig->firmwareVersion);
+    return true;
+  }
+
+  bool success = getSetting(SETTING_FIRMWAREVERSION, versionStr);
+
+  if (success && allocateDeviceConfig())
+  {
+    strcpy(_deviceConfig->firmwareVersion, versionStr);
+    _deviceConfigValidFields |= ConfigFirmwareVersion;
+  }
+
+  return success;
+}
+
+bool BondedHM10::getRole(Role &role)
+{
+  if (isDeviceConfigFieldValid(ConfigRole))
+  {
+    role = _deviceConfig->role;
+    return true;
+  }
+
+  uint8_t value;
+  bool success = getSetting(SETTING_ROLE, value);
+
+  if (success)
+  {
+    role = (Role)value;
+
+    if (allocateDeviceConfig())
+    {
+      _deviceConfig->role = role;
+      _deviceConfigValidFields |= ConfigRole;
+    }
+  }
+
+  return success;
+}
+
+bool BondedHM10::setRole(const Role role)
+{
+  _deviceConfigValidFields &= ~ConfigRole;
+
+  return setSetting(SETTING_ROLE, (uint8_t)role);
+}
+
+bool BondedHM10::getBaudRate(BaudRate &baudRate)
 {
-  _lengthLowByte = 0;
-  _lengthHighByte = 0;
-  _contentCursor = 0;
-  _contentLength = 0;
-  clearString((char *)_contentBuffer, 0);
-  _messageDetected = false;
-  _eventDetected = false;
+  if (isDeviceConfigFieldValid(ConfigBaudRate))
+  {
+    baudRate = _deviceConfig->baudRate;
+    return true;
+  }
+
+  uint8_t value;
+  bool success = getSetting(SETTING_BAUDRATE, value);
+
+  if (success)
+  {
+    baudRate = (BaudRate)value;
+
+    if (allocateDeviceConfig())
+    {
+      _deviceConfig->baudRate = baudRate;
+      _deviceConfigValidFields |= ConfigBaudRate;
+    }
+  }
+
+  return success;
 }
 
-void BondedHM10::resetEventParsing()
+bool BondedHM10::setBaudRate(const BaudRate baudRate)
 {
-  _eventIDLowByte = 0;
-  _eventIDHighByte = 0;
-  _eventID = 0;
-  resetContentParsing();
+  _deviceConfigValidFields &= ~ConfigBaudRate;
+
+  return setSetting(SETTING_BAUDRATE, (uint8_t)baudRate);
 }
 
-void BondedHM10::loop(uint16_t maxBytesToRead)
+bool BondedHM10::getWorkType(WorkType &workType)
+{
+  if (isDeviceConfigFieldValid(ConfigWorkType))
+  {
+    workType = _deviceConfig->workType;
+    return true;
+  }
+
+  uint8_t value;
+  bool success = getSetting(SETTING_WORKTYPE, value);
+
+  if (success)
+  {
+    workType = (WorkType)value;
+
+    if (allocateDeviceConfig())
+    {
+      _deviceConfig->workType = workType;
+      _deviceConfigValidFields |= ConfigWorkType;
+    }
+  }
+
+  return success;
+}
+
+bool BondedHM10::setWorkType(const WorkType workType)
+{
+  _deviceConfigValidFields &= ~ConfigWorkType;
+
+  return setSetting(SETTING_WORKTYPE, (uint8_t)workType);
+}
+
+bool BondedHM10::getLastConnectedAddress(char *address)
+{
+  bool success = getSetting(SETTING_LASTCONNECTEDADDRESS, address);
+
+  if (success && address != _lastConnectedAddressStr)
+  {
+    strncpy(_lastConnectedAddressStr, address, 12);
+  }
+
+  _lastConnectedAddressCached = success;
+
+  return success;
+}
+
+bool BondedHM10::getCachedLastConnectedAddress()
+{
+  // The last connected address only changes when a connection is made or the address is cleared, both of which
+  // keep the cached copy up to date, so the module only needs to be asked when nothing is cached yet.
+  if (_lastConnectedAddressCached)
+  {
+    return true;
+  }
+
+  return getLastConnectedAddress(_lastConnectedAddressStr);
+}
+
+bool BondedHM10::clearLastConnectedAddress()
+{
+  bool success = sendCommandWithExpectedResponse(COMMAND_CLEAR, false, NULL, CLEAR_RESPONSE, _responseStr);
+
+  if (success)
+  {
+    strcpy_P(_lastConnectedAddressStr, EMPTY_ADDRESS);
+  }
+
+  _lastConnectedAddressCached = success;
+
+#ifdef DEBUG
+  if (success)
+  {
+    Serial.println(F("Last connected address cleared."));
+  }
+  else
+  {
+    Serial.print(F("FAILURE: "));
+    Serial.println(_responseStr);
+  }
+
+  Serial.flush();
+#endif
+
+  return success;
+}
+
+bool BondedHM10::getWhitelistEnabled(bool &enabled)
+{
+  if (isDeviceConfigFieldValid(ConfigWhitelistEnabled))
+  {
+    enabled = _deviceConfig->whitelistEnabled;
+    return true;
+  }
+
+  uint8_t value;
+  bool success = getSetting(SETTING_WHITELISTENABLED, value);
+
+  if (success)
+  {
+    enabled = (value != 0);
+
+    if (allocateDeviceConfig())
+    {
+      _deviceConfig->whitelistEnabled = enabled;
+      _deviceConfigValidFields |= ConfigWhitelistEnabled;
+    }
+  }
+
+  return success;
+}
+
+bool BondedHM10::setWhitelistEnabled(const bool enabled)
+{
+  _deviceConfigValidFields &= ~ConfigWhitelistEnabled;
+
+  return setSetting(SETTING_WHITELISTENABLED, (uint8_t)enabled);
+}
+
+bool BondedHM10::getNotificationsEnabled(bool &enabled)
+{
+  if (isDeviceConfigFieldValid(ConfigNotificationsEnabled))
+  {
+    enabled = _deviceConfig->notificationsEnabled;
+    return true;
+  }
+
+  uint8_t value;
+  bool success = getSetting(SETTING_NOTIFICATIONS, value);
+
+  if (success)
+  {
+    enabled = (value != 0);
+
+    if (allocateDeviceConfig())
+    {
+      _deviceConfig->notificationsEnabled = enabled;
+      _deviceConfigValidFields |= ConfigNotificationsEnabled;
+    }
+  }
+
+  return success;
+}
+
+bool BondedHM10::setNotificationsEnabled(const bool enabled)
+{
+  _deviceConfigValidFields &= ~ConfigNotificationsEnabled;
+
+  return setSetting(SETTING_NOTIFICATIONS, (uint8_t)enabled);
+}
+
+bool BondedHM10::getWhitelistAddress(const WhitelistSlot slot, char *address)
+{
+  if (isDeviceConfigFieldValid(whitelistField(slot)))
+  {
+    strcpy(address, _deviceConfig->whitelistAddresses[slot - 1]);
+    return true;
+  }
+
+  uint8_t slotInt = (uint8_t)slot;
+  char whitelistStr[3];
+  sprintf(whitelistStr, "%i?", slotInt);
+
+  bool success = sendCommandWithExpectedResponse(COMMAND_WHITELIST, true, whitelistStr, WHITELIST_RESPONSE, _responseStr);
+
+  // The response repeats the slot and '?' ahead of a ':' and the address, e.g. OK+AD1?:<address>.
+  const uint8_t valueStart = strlen_P(WHITELIST_RESPONSE) + 3;
+
+  if (success && strncmp(_responseStr + valueStart - 3, whitelistStr, 2) == 0 && _responseStr[valueStart - 1] == ':' && strlen(_responseStr + valueStart) <= 12)
+  {
+    strcpy(address, _responseStr + valueStart);
+  }
+  else
+  {
+    success = false;
+  }
+
+#ifdef DEBUG
+  Serial.print(F("Whitelist Address: "));
+
+  if (success)
+  {
+    switch (slot)
+    {
+    case WhitelistSlot::Slot1:
+      Serial.print(F("(Slot1) "));
+      break;
+
+    case WhitelistSlot::Slot2:
+      Serial.print(F("(Slot2) "));
+      break;
+
+    case WhitelistSlot::Slot3:
+      Serial.print(F("(Slot3) "));
+      break;
+    }
+
+    Serial.println(address);
+  }
+  else
+  {
+    Serial.print(F("FAILURE: "));
+    Serial.println(_responseStr);
+  }
+
+  Serial.flush();
+#endif
+
+  if (success && allocateDeviceConfig())
+  {
+    strncpy(_deviceConfig->whitelistAddresses[slot - 1], address, sizeof(DeviceConfig::whitelistAddresses[0]) - 1);
+    _deviceConfigValidFields |= whitelistField(slot);
+  }
+
+  return success;
+}
+
+bool BondedHM10::setWhitelistAddress(const WhitelistSlot slot, const char *address)
+{
+  _deviceConfigValidFields &= ~whitelistField(slot);
+
+  uint8_t slotInt = (uint8_t)slot;
+  char whitelistStr[14];
+  snprintf(whitelistStr, sizeof(whitelistStr), "%i%s", slotInt, address);
+
+  bool success = sendCommandWithExpectedResponse(COMMAND_WHITELIST, false, whitelistStr, WHITELIST_RESPONSE, _responseStr);
+
+#ifdef DEBUG
+  Serial.print(F("SET Whitelist Address: "));
+
+  if (success)
+  {
+    switch (slot)
+    {
+    case WhitelistSlot::Slot1:
+      Serial.print(F("(Slot1) "));
+      break;
+
+    case WhitelistSlot::Slot2:
+      Serial.print(F("(Slot2) "));
+      break;
+
+    case WhitelistSlot::Slot3:
+      Serial.print(F("(Slot3) "));
+      break;
+    }
+
+    Serial.println(address);
+  }
+  else
+  {
+    Serial.print(F("FAILURE: "));
+    Serial.println(_responseStr);
+  }
+
+  Serial.flush();
+#endif
+
+  return success;
+}
+
+bool BondedHM10::getBondMode(BondMode &bondMode)
+{
+  if (isDeviceConfigFieldValid(ConfigBondMode))
+  {
+    bondMode = _deviceConfig->bondMode;
+    return true;
+  }
+
+  uint8_t value;
+  bool success = getSetting(SETTING_BONDMODE, value);
+
+  if (success)
+  {
+    bondMode = (BondMode)value;
+
+    if (allocateDeviceConfig())
+    {
+      _deviceConfig->bondMode = bondMode;
+      _deviceConfigValidFields |= ConfigBondMode;
+    }
+  }
+
+  return success;
+}
+
+bool BondedHM10::setBondMode(const BondMode bondMode)
+{
+  _deviceConfigValidFields &= ~ConfigBondMode;
+
+  return setSetting(SETTING_BONDMODE, (uint8_t)bondMode);
+}
+
+#ifdef DEBUG
+void BondedHM10::printDeviceConfig()
 {
-  if (_initialized)
-  {
-    detectAndHandleConnection();
+  delay(500);
 
-    if (_role == Role::Central)
-    {
-      detectAndHandleDisconnectReconnect();
-    }
+  // Each setting is printed as it is read from the module, so the cache is cleared first to have all of them
+  // printed.
+  DeviceConfig config = {};
 
-    if (_connected)
-    {
-      if (_consoleModeEnabled)
-      {
-        if (Serial)
-        {
-          // TODO: Add while loops here to do the reads/writes in larger batches.
-          // This will also help with support for flashing an LED on communication.
+  invalidateDeviceConfig();
+  getDeviceConfig(config);
+}
+#endif
 
-          if (_stream->available())
-          {
-            if (_dataTransmittedOutputPin >= 0)
-            {
-              startTransmissionTimer();
-            }
+bool BondedHM10::getSetting(const uint8_t setting, char *value)
+{
+  SettingDescriptor descriptor;
+  memcpy_P(&descriptor, &SETTING_DESCRIPTORS[setting], sizeof(SettingDescriptor));
 
-            Serial.write(_stream->read());
-          }
+  bool success = sendCommandWithExpectedResponse(SETTING_DESCRIPTORS[setting].command, true, NULL, SETTING_DESCRIPTORS[setting].response, _responseStr, descriptor.queryTimeout);
+  const char *valueStr = _responseStr + strlen(descriptor.response);
 
-          if (Serial.available())
-          {
-            if (_dataTransmittedOutputPin >= 0)
-            {
-              startTransmissionTimer();
-            }
+  if (success)
+  {
+    uint8_t valueLen = strlen(valueStr);
 
-            _stream->write(Serial.read());
-          }
-        }
-      }
-      else
-      {
-        int bytesAvailable = 0;
-        uint16_t bytesRead = 0;
+    switch (descriptor.type)
+    {
+    case SettingDigit:
+      success = (valueLen == 1 && valueStr[0] >= '0' && valueStr[0] <= ('0' + descriptor.maxValue));
+      break;
 
-        while ((bytesAvailable = _stream->available()) > 0 && bytesRead < MAX_BYTES_READ_PER_LOOP)
-        {
-          const byte currentByte = (byte)_stream->read();
-          bytesRead++;
+    case SettingHex:
+      // Only the last digits are kept, which drops the "0x" some firmware versions put in front.
+      success = (valueLen >= descriptor.maxValue);
+      valueStr += valueLen - descriptor.maxValue;
+      break;
 
-          if (_dataTransmittedOutputPin >= 0)
-          {
-            startTransmissionTimer();
-          }
+    default:
+      success = (valueLen <= descriptor.maxValue);
+      break;
+    }
+  }
 
-#ifdef DEBUG
-#ifdef VERBOSE
-          Serial.println((char)currentByte);
-#endif
-#endif
+  if (success)
+  {
+    strcpy(value, valueStr);
+  }
+  else
+  {
+    clearString(value);
+  }
 
-          if (currentByte == GENERIC_START_BYTE)
-          {
 #ifdef DEBUG
-#ifdef VERBOSE
-            Serial.println(F("Prefix suspected."));
-#endif
+  printSetting(setting, false, success, value);
 #endif
 
-            _prefixCursor = 1; // Move the prefix cursor to the next position.
-            resetContentParsing();
-          }
-          else if (_prefixCursor > 0)
-          {
-            if (currentByte == MESSAGE_PREFIX[_prefixCursor])
-            {
-              if (_prefixCursor == 1 || _messageSuspected)
-              {
-#ifdef DEBUG
-#ifdef VERBOSE
-                if (!_messageSuspected)
-                {
-                  Serial.println(F("Message prefix suspected."));
-                }
-#endif
-#endif
-
-                _messageSuspected = true;
-                _prefixCursor++;
-              }
-              else
-              {
-                resetPrefixDetection();
-              }
-            }
-            else if (currentByte == EVENT_PREFIX[_prefixCursor])
-            {
-              if (_prefixCursor == 1 || _eventSuspected)
-              {
-#ifdef DEBUG
-#ifdef VERBOSE
-                if (!_eventSuspected)
-                {
-                  Serial.println(F("Event prefix suspected."));
-                }
-#endif
-#endif
+  if (descriptor.settleDelay > 0)
+  {
+    delay(descriptor.settleDelay);
+  }
 
-                _eventSuspected = true;
-                _prefixCursor++;
-              }
-              else
-              {
-                resetPrefixDetection();
-              }
-            }
+  return success;
+}
 
-            // Determine if we've read the full event/message prefix.
-            if (_prefixCursor == PREFIX_LEN)
-            {
-              if (_messageSuspected)
-              {
-#ifdef DEBUG
-#ifdef VERBOSE
-                Serial.println(F("Message detected."));
-#endif
-#endif
+bool BondedHM10::setSetting(const uint8_t setting, const char *value)
+{
+  SettingDescriptor descriptor;
+  memcpy_P(&descriptor, &SETTING_DESCRIPTORS[setting], sizeof(SettingDescriptor));
+
+  uint8_t valueLen = strlen(value);
 
-                _messageDetected = true;
-              }
-              else if (_eventSuspected)
-              {
+  if (descriptor.setTimeout == 0 || valueLen > descriptor.maxValue || (descriptor.type == SettingDigit && (valueLen != 1 || value[0] < '0' || value[0] > ('0' + descriptor.maxValue))) || (descriptor.type == SettingHex && valueLen != descriptor.maxValue))
+  {
 #ifdef DEBUG
-#ifdef VERBOSE
-                Serial.println(F("Event detected."));
+    Serial.print(F("SET "));
+    Serial.print(descriptor.command);
+    Serial.println(F(" failed. The value isn't valid for this setting."));
 #endif
-#endif
-
-                _eventDetected = true;
-              }
 
-              resetPrefixDetection();
-            }
-          }
-          else if (_eventDetected)
-          {
-            // The first 2 bytes of the event form a uint16_t that reveals the Event ID.
-            if (_contentCursor == 0)
-            {
-              _eventIDLowByte = currentByte;
-            }
-            else if (_contentCursor == 1)
-            {
-              _eventIDHighByte = currentByte;
-              _eventID = (uint16_t)word(_eventIDHighByte, _eventIDLowByte);
+    return false;
+  }
 
-#ifdef DEBUG
-#ifdef VERBOSE
-              Serial.print(F("Event ID detected: "));
-              Serial.println(_eventID);
-#endif
-#endif
-            }
-            else if (_contentCursor == 2)
-            {
-              _lengthLowByte = currentByte;
-            }
-            else if (_contentCursor == 3)
-            {
-              _lengthHighByte = currentByte;
-              _contentLength = (uint16_t)word(_lengthHighByte, _lengthLowByte);
-              clearString((char *)_contentBuffer);
+  bool success = sendCommandWithExpectedResponse(SETTING_DESCRIPTORS[setting].command, false, value, RESPONSE_OKSET, _responseStr, descriptor.setTimeout);
 
-              if (_contentLength < 1)
-              {
 #ifdef DEBUG
-#ifdef VERBOSE
-                Serial.print(F("Invalid event content length detected: "));
-                Serial.println(_contentLength);
-#endif
+  printSetting(setting, true, success, value);
 #endif
 
-                resetEventParsing();
-                continue;
-              }
+  if (descriptor.settleDelay > 0)
+  {
+    delay(descriptor.settleDelay);
+  }
 
-#ifdef DEBUG
-#ifdef VERBOSE
-              Serial.print(F("Length detected: "));
-              Serial.println(_contentLength);
-#endif
-#endif
-            }
-            else if (_contentLength > 0 && _contentCursor >= 4 && (_contentCursor < (_contentLength + 4))) // content length + 2 bytes for the event ID + 2 bytes for the length
-            {
-              _contentBuffer[_contentCursor - 4] = (uint8_t)currentByte;
-            }
-            else
-            {
-              resetEventParsing();
-              continue;
-            }
+  return success;
+}
 
-            _contentCursor++;
+bool BondedHM10::getSetting(const uint8_t setting, uint8_t &value)
+{
+  char valueStr[2];
+  bool success = getSetting(setting, valueStr);
 
-            if (_contentCursor == (_contentLength + 4)) // _contentLength + 2 bytes for the eventID + 2 bytes for the length.
-            {
-              clearString((char *)_contentBuffer, _contentLength);
+  if (success)
+  {
+    // getSetting() has already checked the digit is in range, and it is also the value of the matching enum.
+    value = valueStr[0] - '0';
+  }
 
-#ifdef DEBUG
-#ifdef VERBOSE
-              Serial.print(F("Event received:"));
-              Serial.println((char *)_contentBuffer);
-#endif
-#endif
+  return success;
+}
 
-              if (_eventReceivedUInt8Handler)
-              {
-                _eventReceivedUInt8Handler(_eventID, _contentBuffer, _contentLength);
-              }
+bool BondedHM10::setSetting(const uint8_t setting, const uint8_t value)
+{
+  char valueStr[2] = {(char)('0' + value), 0};
 
-              if (_eventReceivedCharHandler)
-              {
-                _eventReceivedCharHandler(_eventID, (char *)_contentBuffer, _contentLength);
-              }
+  return setSetting(setting, valueStr);
+}
 
-              resetEventParsing();
-            }
-          }
-          else if (_messageDetected)
-          {
-            // The first 2 bytes of the message form a uint16_t that reveals the length of the message content.
-            if (_contentCursor == 0)
-            {
-              _lengthLowByte = currentByte;
-            }
-            else if (_contentCursor == 1)
-            {
-              _lengthHighByte = currentByte;
-              _contentLength = (uint16_t)word(_lengthHighByte, _lengthLowByte);
-              clearString((char *)_contentBuffer);
-
-              if (_contentLength < 1)
-              {
 #ifdef DEBUG
-#ifdef VERBOSE
-                Serial.print(F("Invalid message content length detected: "));
-                Serial.println(_contentLength);
-#endif
-#endif
+void BondedHM10::printSetting(const uint8_t setting, const bool set, const bool success, const char *value)
+{
+  const char *valueNames = (const char *)pgm_read_ptr(&SETTING_DESCRIPTORS[setting].valueNames);
 
-                resetContentParsing();
-                continue;
-              }
+  if (set)
+  {
+    Serial.print(F("SET "));
+  }
 
-#ifdef DEBUG
-#ifdef VERBOSE
-              Serial.print(F("Length detected: "));
-              Serial.println(_contentLength);
-#endif
-#endif
-            }
-            else if (_contentCursor < (_contentLength + 2)) // content length + 2 bytes for the length
-            {
-              _contentBuffer[_contentCursor - 2] = (uint8_t)currentByte;
-            }
-            else
-            {
-              resetContentParsing();
-              continue;
-            }
+  Serial.print((const __FlashStringHelper *)SETTING_DESCRIPTORS[setting].command);
+  Serial.print(F(": "));
 
-            _contentCursor++;
+  if (!success)
+  {
+    Serial.print(F("FAILURE: "));
+    Serial.println(_responseStr);
+  }
+  else if (valueNames != NULL)
+  {
+    // Skip past the names of the lower values to get to the one for this value.
+    for (uint8_t i = value[0] - '0'; i > 0; i--)
+    {
+      valueNames += strlen_P(valueNames) + 1;
+    }
 
-            if (_contentCursor == (_contentLength + 2))
-            {
-              clearString((char *)_contentBuffer, _contentLength);
+    Serial.println((const __FlashStringHelper *)valueNames);
+  }
+  else
+  {
+    Serial.println(value);
+  }
 
-#ifdef DEBUG
-#ifdef VERBOSE
-              Serial.print(F("Message received:"));
-              Serial.println((char *)_contentBuffer);
-#endif
+  Serial.flush();
+}
 #endif
 
-              if (_messageReceivedUInt8Handler)
-              {
-                _messageReceivedUInt8Handler(_contentBuffer, _contentLength);
-              }
+bool BondedHM10::getDeviceConfig(DeviceConfig &config)
+{
+  // Only the settings that aren't cached yet are read from the module, back to back.
+  bool success = true;
 
-              if (_messageReceivedCharHandler)
-              {
-                _messageReceivedCharHandler((char *)_contentBuffer, _contentLength);
-              }
+  config = DeviceConfig(); // The getters expect zeroed string buffers.
 
-              resetContentParsing();
-            }
-          }
-        }
-      }
-    }
+  success &= getDeviceName(config.name);
+  success &= getFirmwareVersion(config.firmwareVersion);
+  success &= getBaudRate(config.baudRate);
+  success &= getBondMode(config.bondMode);
+  success &= getAddress(config.address);
+  success &= getRole(config.role);
+  success &= getWorkType(config.workType);
+  success &= getWhitelistEnabled(config.whitelistEnabled);
+  success &= getConnectedOutputStatePins(config.outputStatePins);
+  success &= getNotificationsEnabled(config.notificationsEnabled);
+
+  for (uint8_t slot = WhitelistSlot::Slot1; slot <= WhitelistSlot::Slot3; slot++)
+  {
+    success &= getWhitelistAddress((WhitelistSlot)slot, config.whitelistAddresses[slot - 1]);
   }
+
+  return success;
 }
 
-void BondedHM10::setConsoleModeEnabled(const bool consoleModeEnabled)
+void BondedHM10::invalidateDeviceConfig()
 {
-  _consoleModeEnabled = consoleModeEnabled;
+  _deviceConfigValidFields = 0;
 }
 
-bool BondedHM10::getConsoleModeEnabled()
+bool BondedHM10::isDeviceConfigFieldValid(const uint16_t field)
 {
-  return _consoleModeEnabled;
+  return ((_deviceConfigValidFields & field) != 0);
 }
 
-byte BondedHM10::getConnectedOutputPin()
+uint16_t BondedHM10::whitelistField(const WhitelistSlot slot)
 {
-  return _connectedOutputPin;
+  return (ConfigWhitelistSlot1 << (slot - WhitelistSlot::Slot1));
 }
 
-void BondedHM10::setConnectedOutputPin(const byte connectedOutputPin)
+uint16_t BondedHM10::getFlashStringHelperLength(const __FlashStringHelper *content)
 {
-  if (connectedOutputPin < 0)
-  {
-    clearConnectedOutputPin();
-  }
-  else
+  PGM_P p = reinterpret_cast<PGM_P>(content);
+  uint16_t length = 0;
+
+  while (true)
   {
-    _connectedOutputPin = connectedOutputPin;
+    unsigned char c = pgm_read_byte(p++);
+
+    if (c == 0)
+    {
+      break;
+    }
+
+    length++;
   }
-}
 
-void BondedHM10::clearConnectedOutputPin()
-{
-  digitalWrite(_connectedOutputPin, LOW);
-  _connectedOutputPin = -1;
+  return length;
 }
 
-byte BondedHM10::getDataTransmittedOutputPin()
+void BondedHM10::writeFlashStringHelperContent(const __FlashStringHelper *content)
 {
-  return _dataTransmittedOutputPin;
+  PGM_P p = reinterpret_cast<PGM_P>(content);
+
+  while (true)
+  {
+    uint8_t c = (uint8_t)pgm_read_byte(p++);
+
+    if (c == 0 || !_stream->write(c))
+    {
+      break;
+    }
+  }
 }
 
-void BondedHM10::setDataTransmittedOutputPin(const byte dataTransmittedOutputPin)
+bool BondedHM10::writeFrame(const bool isEvent, const uint16_t id, const uint8_t *content, const uint16_t length, const bool contentInFlash, const Priority priority)
 {
-  if (dataTransmittedOutputPin < 0)
+  if (!_initialized)
   {
-    clearDataTransmittedOutputPin();
+    return false;
+  }
+
+  if (length > _maxContentLength)
+  {
+#ifdef DEBUG
+    Serial.print((isEvent ? F("The length of event content provided (") : F("The length of message content provided (")));
+    Serial.print(length);
+    Serial.print(F(" bytes) surpasses the max length of "));
+    Serial.print(_maxContentLength);
+    Serial.println((isEvent ? F(" bytes allowed for events.") : F(" bytes allowed for messages.")));
+#endif
+
+    return false;
+  }
+
+  if (!_connected)
+  {
+    // Frames written while disconnected can only wait in the offline queue for the connection to come back.
+    if (_offlineQueueEnabled)
+    {
+      return queueOfflineFrame(isEvent, id, content, length, contentInFlash);
+    }
+
+    return false;
+  }
+
+  if (priority == Priority::Low)
+  {
+    // Low priority frames are sent a fragment at a time from loop(). High priority frames are written straight
+    // away, in between the fragments.
+    return queueLowPriorityFrame(isEvent, id, content, length, contentInFlash);
+  }
+
+  if (_offlineQueueItemCount > 0)
+  {
+    // The frames written while disconnected are still being sent from loop(). New frames join the end of that
+    // backlog so they can't overtake it. Nothing is dropped to make room: the frames ahead are sent until it fits.
+    while (_offlineQueueItemCount > 0 && (QUEUE_ITEM_HEADER_SIZE + length) > (getOfflineQueueCapacity() - _offlineQueueUsed))
+    {
+      sendQueuedFragment();
+    }
+
+    if (_offlineQueueItemCount > 0)
+    {
+      return queueOfflineFrame(isEvent, id, content, length, contentInFlash);
+    }
+  }
+
+  unsigned long startTime = millis();
+
+  if (_dataTransmittedOutputPin >= 0)
+  {
+    startTransmissionTimer();
+  }
+
+  writeFrameHeader(isEvent, id, length);
+
+  if (contentInFlash)
+  {
+    writeFlashStringHelperContent((const __FlashStringHelper *)content);
   }
   else
   {
-    _dataTransmittedOutputPin = dataTransmittedOutputPin;
+    _stream->write(content, length);
   }
+
+  updateSendLatencyMetrics(priority, millis() - startTime);
+
+  return true;
 }
 
-void BondedHM10::clearDataTransmittedOutputPin()
+void BondedHM10::updateSendLatencyMetrics(const Priority priority, const unsigned long latency)
 {
-  digitalWrite(_dataTransmittedOutputPin, LOW);
-  _dataTransmittedOutputPin = -1;
-  stopTransmissionTimer();
+  SendLatencyMetrics &metrics = (priority == Priority::High ? _highPrioritySendMetrics : _lowPrioritySendMetrics);
+
+  metrics.frames++;
+  metrics.totalMillis += latency;
+
+  if (latency > metrics.maxMillis)
+  {
+    metrics.maxMillis = latency;
+  }
+}
+
+void BondedHM10::getSendLatencyMetrics(const Priority priority, SendLatencyMetrics &metrics)
+{
+  metrics = (priority == Priority::High ? _highPrioritySendMetrics : _lowPrioritySendMetrics);
+}
+
+void BondedHM10::resetSendLatencyMetrics()
+{
+  memset(&_highPrioritySendMetrics, 0, sizeof(SendLatencyMetrics));
+  memset(&_lowPrioritySendMetrics, 0, sizeof(SendLatencyMetrics));
 }
 
-void BondedHM10::setConnectedHandler(ConnectedDelegate connectedHandler)
-{
-  _connectedHandler = connectedHandler;
-}
+void BondedHM10::writeFrameHeader(const bool isEvent, const uint16_t id, const uint16_t length)
+{
+  writeFrameHeader(isEvent, id, length, millis());
+}
+
+void BondedHM10::writeFrameHeader(const bool isEvent, const uint16_t id, uint16_t length, const unsigned long timestamp)
+{
+  if (_frameTimestampsEnabled)
+  {
+    length |= FRAME_TIMESTAMP_FLAG;
+  }
+
+  if (isEvent)
+  {
+    _stream->write(EVENT_PREFIX, PREFIX_LEN);
+    _stream->write(lowByte(id));
+    _stream->write(highByte(id));
+  }
+  else
+  {
+    _stream->write(MESSAGE_PREFIX, PREFIX_LEN);
+  }
+
+  _stream->write(lowByte(length));
+  _stream->write(highByte(length));
 
-void BondedHM10::setDisconnectedHandler(DisconnectedDelegate disconnectedHandler)
-{
-  _disconnectedHandler = disconnectedHandler;
-}
+  if (_frameTimestampsEnabled)
+  {
+    uint8_t stamp[4];
 
-byte BondedHM10::getDisconnectReconnectInputPin()
-{
-  return _disconnectReconnectInputPin;
+    writeUInt32(stamp, timestamp);
+    _stream->write(stamp, 4);
+  }
 }
 
-void BondedHM10::setDisconnectReconnectInputPin(const byte disconnectReconnectInputPin)
+bool BondedHM10::writeEvent(uint16_t id, const uint8_t *content, const uint16_t length)
 {
-  _disconnectReconnectInputPin = disconnectReconnectInputPin;
+  return writeEvent(id, content, length, Priority::High);
 }
 
-void BondedHM10::clearDisconnectReconnectInputPin()
+bool BondedHM10::writeEvent(uint16_t id, const char *content)
 {
-  _disconnectReconnectInputPin = -1;
+  return writeEvent(id, content, strlen(content));
 }
 
-bool BondedHM10::getAutoReconnectEnabled()
+bool BondedHM10::writeEvent(uint16_t id, const char *content, const uint16_t length)
 {
-  return _autoReconnectEnabled;
+  return writeEvent(id, (const uint8_t *)content, length);
 }
 
-void BondedHM10::setAutoReconnectEnabled(const bool enabled)
+bool BondedHM10::writeEvent(uint16_t id, const __FlashStringHelper *content)
 {
-  _autoReconnectEnabled = enabled;
+  return writeEvent(id, content, Priority::High);
 }
 
-long BondedHM10::getAutoReconnectTimeout()
+bool BondedHM10::writeEvent(uint16_t id, const uint8_t *content, const uint16_t length, const Priority priority)
 {
-  return _autoReconnectTimeout;
+  if (!isUserEventID(id))
+  {
+    return false;
+  }
+
+  return writeFrame(true, id, content, length, false, priority);
 }
 
-void BondedHM10::setAutoReconnectTimeout(const unsigned long timeout)
+bool BondedHM10::writeEvent(uint16_t id, const char *content, const Priority priority)
 {
-  _autoReconnectTimeout = timeout;
+  return writeEvent(id, (const uint8_t *)content, strlen(content), priority);
 }
 
-bool BondedHM10::isConnected(bool testForTransientConnection)
+bool BondedHM10::writeEvent(uint16_t id, const __FlashStringHelper *content, const Priority priority)
 {
-  if (!testForTransientConnection)
+  if (!isUserEventID(id))
   {
-    return (digitalRead(_statePin) == HIGH);
+    return false;
   }
-  else
-  {
-    byte testIndex = 0;
 
-    while (testIndex < TRANSIENTCONNECTTEST_RETRYCOUNT)
-    {
-      if (digitalRead(_statePin) == LOW)
-      {
-#ifdef DEBUG
-#ifdef VERBOSE
-        Serial.println(F("STATE pin on chip reads LOW (connection NOT active)."));
-#endif
-#endif
+  return writeFrame(true, id, (const uint8_t *)content, getFlashStringHelperLength(content), true, priority);
+}
 
-        return false;
-      }
-      else
-      {
+bool BondedHM10::isUserEventID(const uint16_t id)
+{
+  if (id >= RESERVED_EVENT_ID_BASE)
+  {
 #ifdef DEBUG
-#ifdef VERBOSE
-        Serial.println(F("STATE pin on chip reads HIGH (connection active)."));
-#endif
+    Serial.print(F("Event ID "));
+    Serial.print(id);
+    Serial.println(F(" is reserved for use by the BondedHM10 library."));
 #endif
-      }
-
-      delay(TRANSIENTCONNECTTEST_DELAY);
-      testIndex++;
-    }
 
-    return true;
+    return false;
   }
+
+  return true;
 }
 
-bool BondedHM10::isConnected()
+bool BondedHM10::isControlEvent(const uint16_t id)
 {
-  return isConnected(false);
+  // Control events are consumed by the library itself. The rest of the reserved events (channel data, RPC calls,
+  // blob transfers) are passed on to application handlers.
+  return (id == CHANNEL_CREDIT_EVENT_ID || id == PING_EVENT_ID || id == PONG_EVENT_ID || id == CLOCK_SYNC_REQUEST_EVENT_ID || id == CLOCK_SYNC_RESPONSE_EVENT_ID || id == HEARTBEAT_EVENT_ID || id == HEARTBEAT_ACK_EVENT_ID || id == WARM_START_EVENT_ID || id == WARM_START_ACK_EVENT_ID);
 }
 
-bool BondedHM10::disconnect()
+bool BondedHM10::writeControlEvent(const uint16_t id, const uint8_t *header, const uint8_t headerLength, const uint8_t *content, const uint16_t length)
 {
-  if (_initialized && (_role == Role::Central) && _connected)
+  // Control events only make sense for the current connection, so they are never put in the offline queue.
+  if (!_initialized || !_connected || (headerLength + length) > _maxContentLength)
   {
-    reset();
-    detectAndHandleConnection();
+    return false;
+  }
 
-    bool success = false;
+  unsigned long startTime = millis();
 
-    if (!isConnected(true))
-    {
-      success = true;
-    }
+  if (_dataTransmittedOutputPin >= 0)
+  {
+    startTransmissionTimer();
+  }
 
-#ifdef DEBUG
-    if (success)
-    {
-      Serial.println(F("Disconnected."));
-    }
-    else
-    {
-      Serial.println(F("Disconnect FAILED."));
-    }
+  writeFrameHeader(true, id, headerLength + length);
+  _stream->write(header, headerLength);
 
-    Serial.flush();
-#endif
+  if (length > 0)
+  {
+    _stream->write(content, length);
+  }
 
-    return success;
+  updateSendLatencyMetrics(Priority::High, millis() - startTime);
+
+  return true;
+}
+
+void BondedHM10::dispatchReservedEvent(const uint16_t id, uint8_t *content, const uint16_t length)
+{
+  if (id == RPC_REQUEST_EVENT_ID)
+  {
+    dispatchRpcRequest(content, length);
+  }
+  else if (id == RPC_RESPONSE_EVENT_ID)
+  {
+    dispatchRpcResponse(content, length);
+  }
+  else if (id >= BLOB_START_EVENT_ID && id <= BLOB_RESULT_EVENT_ID)
+  {
+    dispatchBlobEvent(id, content, length);
   }
   else
   {
-    return false;
+    dispatchChannelFrame(id - CHANNEL_EVENT_ID_BASE, content, length);
   }
 }
 
-bool BondedHM10::startWork()
+void BondedHM10::handleControlEvent(const uint16_t id, const uint8_t *content, const uint16_t length)
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_START, false, NULL, START_RESPONSE, _responseStr);
-
-#ifdef DEBUG
-  Serial.print(F("START WORK"));
+  if (id == CHANNEL_CREDIT_EVENT_ID && length >= 2)
+  {
+    receiveChannelCredits(content[0], content[1]);
+  }
+  else if (id == PING_EVENT_ID)
+  {
+    // Answered straight from the receive path, so the round trip time doesn't include time spent waiting on
+    // (deferred) handlers.
+    writeControlEvent(PONG_EVENT_ID, content, (uint8_t)min(length, 4), NULL, 0);
+  }
+  else if (id == PONG_EVENT_ID && length >= 4)
+  {
+    recordRoundTrip(micros() - readUInt32(content));
+  }
+  else if (id == CLOCK_SYNC_REQUEST_EVENT_ID && length >= 4)
+  {
+    // Echo the request time back along with the local time it was received at (and, for completeness, the time
+    // the response is sent, which is the same since it is answered right away).
+    uint8_t header[12];
 
-  if (!success)
+    memcpy(header, content, 4);
+    writeUInt32(header + 4, millis());
+    writeUInt32(header + 8, millis());
+    writeControlEvent(CLOCK_SYNC_RESPONSE_EVENT_ID, header, 12, NULL, 0);
+  }
+  else if (id == CLOCK_SYNC_RESPONSE_EVENT_ID && length >= 12)
   {
-    Serial.print(F(": FAILURE: "));
-    Serial.println(_responseStr);
+    updateClockSync(readUInt32(content), readUInt32(content + 4), readUInt32(content + 8), millis());
   }
-  else
+  else if (id == WARM_START_EVENT_ID && length >= 4)
   {
-    Serial.println();
+    writeControlEvent(WARM_START_ACK_EVENT_ID, content, 4, NULL, 0);
   }
+  else if (id == WARM_START_ACK_EVENT_ID && length >= 4)
+  {
+    _warmStartAcknowledged = (readUInt32(content) == _warmStartNonce);
+  }
+  else if (id == HEARTBEAT_EVENT_ID)
+  {
+    // Receiving the heartbeat already counts as a sign of life on this side, the ack does the same for the remote.
+    uint8_t header[1] = {0};
+    writeControlEvent(HEARTBEAT_ACK_EVENT_ID, header, 1, NULL, 0);
+  }
+}
 
-  Serial.flush();
-#endif
+void BondedHM10::setHeartbeat(const unsigned long interval, const uint8_t missLimit)
+{
+  _heartbeatInterval = interval;
+  _heartbeatMissLimit = max(1, missLimit);
+  _heartbeatMisses = 0;
+  _lastReceiveTime = millis();
+}
 
-  return success;
+unsigned long BondedHM10::getHeartbeatInterval()
+{
+  return _heartbeatInterval;
 }
 
-bool BondedHM10::connectToPeripheral()
+uint16_t BondedHM10::getHeartbeatTimeoutCount()
 {
-  if (_role != Role::Central)
+  return _heartbeatTimeoutCount;
+}
+
+void BondedHM10::checkHeartbeat()
+{
+  unsigned long now = millis();
+
+  // Heartbeats are only sent once nothing has been received for a full interval, so they cost nothing while data
+  // is flowing.
+  if ((now - _lastReceiveTime) < _heartbeatInterval || (now - _lastHeartbeatTime) < _heartbeatInterval)
   {
-    return false;
+    return;
   }
 
-  if (_connecting)
+  _lastHeartbeatTime = now;
+
+  if (_heartbeatMisses < _heartbeatMissLimit)
   {
-#ifdef DEBUG
-    Serial.println(F("connectToPeripheral exited early. Connecting in progress..."));
-#endif
+    uint8_t header[1] = {0};
 
-    return false;
+    writeControlEvent(HEARTBEAT_EVENT_ID, header, 1, NULL, 0);
+    _heartbeatMisses++;
+    return;
   }
 
+  // The STATE pin can stay HIGH for a long time after the remote has gone away (the HM-10 holds on to the
+  // connection), so the link is torn down by resetting the module and the usual reconnect path takes over.
 #ifdef DEBUG
-  Serial.print(F("Attempting to connect to peripheral at "));
-  Serial.print(_remoteAddress);
-  Serial.println(F("..."));
+  Serial.println(F("No heartbeat from the remote. Resetting the connection."));
 #endif
 
-  _connecting = true;
-  bool success = sendCommandWithExpectedResponse(COMMAND_CONNECT, false, _remoteAddress, CONNECT_RESPONSE, _responseStr, CONNECT_COMMAND_TIMEOUT);
+  _heartbeatTimeoutCount++;
+  _heartbeatMisses = 0;
 
-  if (success)
+  reset();
+  _connectionStateChangeTimestamp = millis();
+  onDisconnect();
+
+  // Try to reconnect straight away rather than waiting out the auto-reconnect timeout.
+  _lastConnectAttemptTimestamp = millis() - getJitteredReconnectDelay();
+}
+
+bool BondedHM10::syncClock()
+{
+  if (!allocateClockState())
   {
-    char *responseCode = (char *)calloc(2, sizeof(char));
+    return false;
+  }
 
-    parseCommandResponseValue(CONNECT_RESPONSE, _responseStr, responseCode);
+  uint8_t header[4];
 
-    if (responseCode[0] == 'A')
-    {
-      if (waitForResponse(CONNECT_FAILURE_RESPONSE, _responseStr, CONNECTING_COMMAND_TIMEOUT))
-      {
-        // We received at AT+CONNF response (failure).
-        if (isConnected())
-        {
-          success = true;
+  _lastClockSyncRequestTime = millis();
+  writeUInt32(header, _lastClockSyncRequestTime);
 
-#ifdef DEBUG
-          Serial.println(F("SUCCESS: Already connected."));
-#endif
-        }
-        else
-        {
-          success = false;
+  return writeControlEvent(CLOCK_SYNC_REQUEST_EVENT_ID, header, 4, NULL, 0);
+}
 
-#ifdef DEBUG
-          Serial.println(F("FAILURE: Peripheral unavailable."));
-#endif
-        }
-      }
-      else
-      {
-        if (isConnected())
-        {
-          success = true;
+void BondedHM10::setClockSyncInterval(const unsigned long interval)
+{
+  _clockSyncInterval = interval;
+}
 
-#ifdef DEBUG
-          Serial.println(F("SUCCESS: Connected."));
-#endif
-        }
-        else
-        {
-          success = false;
+unsigned long BondedHM10::getClockSyncInterval()
+{
+  return _clockSyncInterval;
+}
 
-#ifdef DEBUG
-          Serial.println(F("FAILURE: Peripheral unavailable."));
-#endif
-        }
-      }
-    }
-    else if (responseCode[0] == 'E')
-    {
-      success = false;
+void BondedHM10::updateClockSync(const unsigned long requestTime, const unsigned long remoteReceiveTime, const unsigned long remoteSendTime, const unsigned long responseTime)
+{
+  if (_clock == NULL)
+  {
+    // Only requests sent by syncClock() are answered, and it allocates the state.
+    return;
+  }
 
-#ifdef DEBUG
-      Serial.println(F("FAILURE: Connect Error."));
-#endif
-    }
-    else if (responseCode[0] == 'F')
-    {
-      success = false;
+  // The usual NTP estimate: assuming the link is equally fast both ways, the remote clock is ahead by the average
+  // of the differences seen on the way there and on the way back.
+  long offset = ((long)(remoteReceiveTime - requestTime) + (long)(remoteSendTime - responseTime)) / 2;
+  long expectedOffset = (long)(remoteMillis(responseTime) - responseTime);
 
-#ifdef DEBUG
-      Serial.println(F("FAILURE: Peripheral unavailable."));
-#endif
-    }
-    else if (strlen(responseCode) == 0)
-    {
-      success = true;
+  if (!_clock->synchronized || labs(offset - expectedOffset) > (long)(responseTime - requestTime))
+  {
+    // The first sample, or one that is further from where the clocks should be than the round trip can explain
+    // (e.g. the remote restarted without the link dropping). Either way the drift is measured from here on.
+    _clock->synchronized = true;
+    _clock->driftBaseTime = responseTime;
+    _clock->driftBaseOffset = offset;
+  }
+  else if ((responseTime - _clock->driftBaseTime) >= CLOCK_DRIFT_MIN_SPAN)
+  {
+    // The drift is measured over the whole time since the first sync, since the change in offset between two
+    // syncs close together is lost in the millisecond resolution.
+    _clock->drift = (long)((float)(offset - _clock->driftBaseOffset) * 1000000.0f / (float)(responseTime - _clock->driftBaseTime));
+  }
 
-#ifdef DEBUG
-      Serial.println(F("SUCCESS: Already connected."));
-#endif
-    }
-    else
-    {
-      success = false;
+  _clock->offset = offset;
+  _clock->lastSyncTime = responseTime;
+}
 
-#ifdef DEBUG
-      Serial.print(F("FAILURE: Unknown response code: "));
-      Serial.println(responseCode[0]);
-#endif
-    }
+bool BondedHM10::isClockSynchronized()
+{
+  return (_clock != NULL && _clock->synchronized);
+}
 
-    free(responseCode);
-  }
-  else
+long BondedHM10::getClockOffset()
+{
+  return (_clock != NULL ? _clock->offset : 0);
+}
+
+long BondedHM10::getClockDrift()
+{
+  return (_clock != NULL ? _clock->drift : 0);
+}
+
+unsigned long BondedHM10::remoteMillis()
+{
+  return remoteMillis(millis());
+}
+
+unsigned long BondedHM10::remoteMillis(const unsigned long localTime)
+{
+  if (_clock == NULL)
   {
-#ifdef DEBUG
-    Serial.println(F("FAILURE: Reason unknown."));
-#endif
+    return localTime;
   }
 
-  _connecting = false;
+  long driftCorrection = (long)((float)_clock->drift * (float)(long)(localTime - _clock->lastSyncTime) / 1000000.0f);
 
-  return success;
+  return localTime + _clock->offset + driftCorrection;
 }
 
-bool BondedHM10::reconnectToPeripheral()
+unsigned long BondedHM10::localMillis(const unsigned long remoteTime)
 {
-  if (_connecting)
+  if (_clock == NULL)
   {
-#ifdef DEBUG
-    Serial.println(F("reconnectToPeripheral exited early. Connecting in progress..."));
-#endif
-
-    return false;
+    return remoteTime;
   }
 
-  bool success = startWork();
+  long driftCorrection = (long)((float)_clock->drift * (float)(long)(remoteTime - _clock->offset - _clock->lastSyncTime) / 1000000.0f);
 
-  if (success)
-  {
-    // Get the last connected address. If we think it's a valid address, then just call startWork to auto connect to the
-    // peripheral. If it is not a valid address, then attempt to manually connect to the hardcoded peripheral address.
-    char *lastConnectedAddress = (char *)calloc(13, sizeof(char)); // We aren't using btLastConnectedAddressStr here to avoid having to sync access to the variable.
+  return remoteTime - _clock->offset - driftCorrection;
+}
 
-    if (getLastConnectedAddress(lastConnectedAddress))
-    {
-      if (strcmp(lastConnectedAddress, EMPTY_ADDRESS) == 0)
-      {
-        success = connectToPeripheral();
-      }
-      else
-      {
-        _connecting = true;
-      }
-    }
+void BondedHM10::setFrameTimestampsEnabled(const bool enabled)
+{
+  _frameTimestampsEnabled = enabled;
+}
+
+bool BondedHM10::isFrameTimestampsEnabled()
+{
+  return _frameTimestampsEnabled;
+}
+
+unsigned long BondedHM10::getFrameTimestamp()
+{
+  return _receivedFrameTimestamp;
+}
 
-    free(lastConnectedAddress);
+long BondedHM10::getFrameLatency()
+{
+  // Only meaningful once the clocks are in sync, and when the sender stamps its frames.
+  if (!isClockSynchronized() || _receivedFrameTimestamp == 0)
+  {
+    return -1;
   }
 
-  return success;
+  return (long)(millis() - localMillis(_receivedFrameTimestamp));
 }
 
-void BondedHM10::reset()
+bool BondedHM10::ping()
 {
-  digitalWrite(_resetPin, LOW);
-  delay(101); // Hold the RESET pin LOW for at least 100 miliseconds to trigger a reset of the bluetooth device.
-  digitalWrite(_resetPin, HIGH);
+  // The time the ping was sent travels with it (and is echoed back), so any number of pings can be in flight.
+  uint8_t header[4];
 
-  delay(250);
+  writeUInt32(header, micros());
+  _lastPingTime = millis();
+
+  return writeControlEvent(PING_EVENT_ID, header, 4, NULL, 0);
 }
 
-bool BondedHM10::setConnectedOutputStatePins(const char *pinHex)
+void BondedHM10::setPingInterval(const unsigned long interval)
 {
-  if (strlen(pinHex) != 3)
-  {
-#ifdef DEBUG
-    Serial.println(F("setConnectionOutputStatePins failed. Only a 3 digit hex string is accepted as input."));
-#endif
+  _pingInterval = interval;
+}
 
-    return false;
-  }
+unsigned long BondedHM10::getPingInterval()
+{
+  return _pingInterval;
+}
 
-  bool success = sendCommandWithExpectedResponse(COMMAND_CON_OUTPUTSTATE_PIN, false, pinHex, RESPONSE_OKSET, _responseStr, 2000);
+void BondedHM10::setPingHandler(PingDelegate pingHandler)
+{
+  _pingHandler = pingHandler;
+}
 
-#ifdef DEBUG
-  Serial.print(F("SET Connected Output State Pins: "));
+void BondedHM10::recordRoundTrip(const unsigned long roundTripMicros)
+{
+  uint16_t roundTrip = (uint16_t)min(roundTripMicros / 1000UL, 0xFFFFUL);
+  uint8_t bucket = 0;
 
-  if (success)
+  while (bucket < (ROUND_TRIP_BUCKET_COUNT - 1) && roundTrip > pgm_read_word(&ROUND_TRIP_BUCKET_LIMITS[bucket]))
   {
-    Serial.println(pinHex);
+    bucket++;
   }
-  else
+
+  if (allocateRoundTripState())
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
-  }
+    _roundTrip->buckets[bucket]++;
+    _roundTrip->sampleCount++;
 
-  Serial.flush();
-#endif
+    if (roundTrip > _roundTrip->max)
+    {
+      _roundTrip->max = roundTrip;
+    }
 
-  return success;
-}
+    if (_roundTrip->sampleCount >= ROUND_TRIP_HISTORY_SIZE)
+    {
+      // Halve the counts so the histogram follows the current state of the link, with older round trips fading
+      // out rather than piling up forever. The max of the previous period is kept around for one more period.
+      _roundTrip->sampleCount = 0;
 
-bool BondedHM10::getDeviceName(char *deviceName)
-{
-  bool success = sendCommandWithExpectedResponse(COMMAND_NAME, true, NULL, NAME_RESPONSE, _responseStr);
+      for (uint8_t i = 0; i < ROUND_TRIP_BUCKET_COUNT; i++)
+      {
+        _roundTrip->buckets[i] /= 2;
+        _roundTrip->sampleCount += _roundTrip->buckets[i];
+      }
 
-  if (success)
-  {
-    parseCommandResponseValue(NAME_RESPONSE, _responseStr, deviceName);
+      _roundTrip->previousMax = _roundTrip->max;
+      _roundTrip->max = 0;
+    }
   }
 
-#ifdef DEBUG
-  Serial.print(F("Device Name: "));
-
-  if (success)
+  if (_pingHandler)
   {
-    Serial.println(deviceName);
+    _pingHandler(roundTripMicros);
   }
-  else
+}
+
+uint16_t BondedHM10::getRoundTripPercentile(const uint8_t percentile)
+{
+  if (_roundTrip == NULL || _roundTrip->sampleCount == 0)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    return 0;
   }
 
-  Serial.flush();
-#endif
+  // Reports the upper limit of the bucket the percentile falls in (or the max for the last bucket).
+  uint32_t target = ((uint32_t)_roundTrip->sampleCount * percentile + 99) / 100;
+  uint32_t count = 0;
 
-  if (!success)
+  for (uint8_t i = 0; i < (ROUND_TRIP_BUCKET_COUNT - 1); i++)
   {
-    clearString(deviceName);
+    count += _roundTrip->buckets[i];
+
+    if (count >= target && count > 0)
+    {
+      return (uint16_t)min((uint16_t)pgm_read_word(&ROUND_TRIP_BUCKET_LIMITS[i]), getRoundTripMax());
+    }
   }
 
-  return success;
+  return getRoundTripMax();
 }
 
-bool BondedHM10::setDeviceName(const char *deviceName)
+uint16_t BondedHM10::getRoundTripMax()
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_NAME, false, deviceName, RESPONSE_OKSET, _responseStr);
+  return (_roundTrip != NULL ? max(_roundTrip->max, _roundTrip->previousMax) : 0);
+}
 
-#ifdef DEBUG
-  Serial.print(F("SET Device name: "));
-  Serial.println(deviceName);
+uint16_t BondedHM10::getRoundTripSampleCount()
+{
+  return (_roundTrip != NULL ? _roundTrip->sampleCount : 0);
+}
 
-  if (!success)
+void BondedHM10::resetRoundTripHistogram()
+{
+  if (_roundTrip != NULL)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    memset(_roundTrip, 0, sizeof(RoundTripState));
   }
-
-  Serial.flush();
-#endif
-
-  return success;
 }
 
-bool BondedHM10::getAddress(char *address)
+bool BondedHM10::openChannel(const uint8_t channel, const uint8_t receiveWindow)
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_ADDRESS, true, NULL, ADDRESS_RESPONSE, _responseStr);
-
-  if (success)
+  if (channel >= MAX_CHANNELS || receiveWindow < 1 || !allocateChannels())
   {
-    parseCommandResponseValue(ADDRESS_RESPONSE, _responseStr, address);
+    return false;
   }
 
-#ifdef DEBUG
-  Serial.print(F("Address: "));
+  Channel &ch = _channels[channel];
 
-  if (success)
-  {
-    Serial.println(address);
-  }
-  else
+  if (ch.queue == NULL)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    // Only allocated when a channel is first opened, so sketches that never use channels don't pay for them.
+    ch.queue = (uint8_t *)allocate(_channelQueueSize, sizeof(uint8_t));
+
+    if (ch.queue == NULL)
+    {
+      return false;
+    }
   }
 
-  Serial.flush();
-#endif
+  ch.open = true;
+  ch.receiveWindow = receiveWindow;
+  ch.consumed = 0;
 
-  if (!success)
-  {
-    clearString(address);
-  }
+  // Let the remote know how many frames it may send on this channel.
+  sendChannelCredits(channel, receiveWindow);
 
-  return success;
+  return true;
 }
 
-bool BondedHM10::getFirmwareVersion(char *versionStr)
+void BondedHM10::closeChannel(const uint8_t channel)
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_VERSION, true, NULL, NULL, _responseStr);
+  if (channel < MAX_CHANNELS && _channels != NULL)
+  {
+    Channel &ch = _channels[channel];
 
-  if (success)
+    ch.open = false;
+    ch.queueHead = 0;
+    ch.queueUsed = 0;
+    ch.queuedFrames = 0;
+    ch.credits = 0;
+  }
+}
+
+bool BondedHM10::writeChannel(const uint8_t channel, const uint8_t *content, const uint16_t length)
+{
+  if (channel >= MAX_CHANNELS || _channels == NULL || !_channels[channel].open || length < 1)
   {
-    parseCommandResponseValue(NULL, _responseStr, versionStr);
+    return false;
   }
 
+  if (length > _maxContentLength)
+  {
 #ifdef DEBUG
-  Serial.print(F("Firmware Version: "));
+    Serial.print(F("The length of channel content provided ("));
+    Serial.print(length);
+    Serial.print(F(" bytes) surpasses the max length of "));
+    Serial.print(_maxContentLength);
+    Serial.println(F(" bytes allowed for channels."));
+#endif
 
-  if (success)
-  {
-    Serial.println(versionStr);
+    return false;
   }
-  else
+
+  Channel &ch = _channels[channel];
+  const uint16_t itemSize = 2 + length; // 2 bytes for the length + the content.
+
+  if (itemSize > (_channelQueueSize - ch.queueUsed))
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+#ifdef DEBUG
+    Serial.print(F("Channel "));
+    Serial.print(channel);
+    Serial.println(F(" queue full."));
+#endif
+
+    return false;
   }
 
-  Serial.flush();
-#endif
+  uint16_t index = (ch.queueHead + ch.queueUsed) % _channelQueueSize;
 
-  if (!success)
+  ch.queue[index] = lowByte(length);
+  index = (index + 1) % _channelQueueSize;
+  ch.queue[index] = highByte(length);
+
+  for (uint16_t i = 0; i < length; i++)
   {
-    clearString(versionStr);
+    index = (index + 1) % _channelQueueSize;
+    ch.queue[index] = content[i];
   }
 
-  return success;
+  ch.queueUsed += itemSize;
+  ch.queuedFrames++;
+
+  return true;
 }
 
-bool BondedHM10::getRole(Role &role)
+bool BondedHM10::writeChannel(const uint8_t channel, const char *content)
+{
+  return writeChannel(channel, (const uint8_t *)content, strlen(content));
+}
+
+uint8_t BondedHM10::getChannelQueueCount(const uint8_t channel)
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_ROLE, true, NULL, RESPONSE_OKGET, _responseStr);
+  return (channel < MAX_CHANNELS && _channels != NULL ? _channels[channel].queuedFrames : 0);
+}
 
-  if (success)
-  {
-    char *responseCode = (char *)calloc(2, sizeof(char));
+uint8_t BondedHM10::getChannelCredits(const uint8_t channel)
+{
+  return (channel < MAX_CHANNELS && _channels != NULL ? _channels[channel].credits : 0);
+}
+
+void BondedHM10::setChannelReceivedHandler(ChannelReceivedDelegate channelReceivedHandler)
+{
+  _channelReceivedHandler = channelReceivedHandler;
+}
 
-    parseCommandResponseValue(RESPONSE_OKGET, _responseStr, responseCode);
+void BondedHM10::serviceChannels()
+{
+  // Round-robin over the channels, sending at most one frame from each channel that has something queued and
+  // credits left, so that one busy channel can't hold up the others.
+  for (uint8_t i = 1; i <= MAX_CHANNELS && _channels != NULL && _connected; i++)
+  {
+    const uint8_t channel = (_lastServicedChannel + i) % MAX_CHANNELS;
+    Channel &ch = _channels[channel];
 
-    if (responseCode[0] == '0')
+    if (!ch.open || ch.queuedFrames == 0 || ch.credits == 0)
     {
-      role = Role::Peripheral;
+      continue;
     }
-    else if (responseCode[0] == '1')
+
+    const uint16_t length = (uint16_t)word(ch.queue[(ch.queueHead + 1) % _channelQueueSize], ch.queue[ch.queueHead]);
+
+    if (_dataTransmittedOutputPin >= 0)
     {
-      role = Role::Central;
+      startTransmissionTimer();
     }
-    else
+
+    writeFrameHeader(true, CHANNEL_EVENT_ID_BASE + channel, length);
+
+    for (uint16_t position = 2; position < (length + 2); position++)
     {
-      success = false;
+      _stream->write(ch.queue[(ch.queueHead + position) % _channelQueueSize]);
     }
 
-    free(responseCode);
-  }
-
-#ifdef DEBUG
-  Serial.print(F("Role: "));
+    ch.queueHead = (ch.queueHead + length + 2) % _channelQueueSize;
+    ch.queueUsed -= (length + 2);
+    ch.queuedFrames--;
+    ch.credits--;
 
-  if (success)
-  {
-    switch (role)
+    if (ch.queuedFrames == 0)
     {
-    case Role::Central:
-      Serial.println(F("Central"));
-      break;
-
-    case Role::Peripheral:
-      Serial.println(F("Peripheral"));
-      break;
+      ch.queueHead = 0;
     }
+
+    _lastServicedChannel = channel;
   }
-  else
+}
+
+void BondedHM10::dispatchChannelFrame(const uint8_t channel, uint8_t *content, const uint16_t length)
+{
+  if (channel >= MAX_CHANNELS || _channels == NULL || !_channels[channel].open)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    dropReceivedFrame(true, CHANNEL_EVENT_ID_BASE + channel);
+    return;
   }
 
-  Serial.flush();
-#endif
+  if (_channelReceivedHandler)
+  {
+    _channelReceivedHandler(channel, content, length);
+  }
 
-  return success;
+  // The credit is handed back once the frame has been handled (which is only in dispatch() when dispatching is
+  // deferred).
+  returnChannelCredit(channel);
 }
 
-bool BondedHM10::setRole(const Role role)
+void BondedHM10::returnChannelCredit(const uint8_t channel)
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_ROLE, false, (role == Role::Central ? "1" : "0"), RESPONSE_OKSET, _responseStr);
+  // Every channel frame that arrives used up one of the sender's credits, so one is handed back whether the frame
+  // was delivered or dropped. Otherwise each dropped frame would shrink the sender's window for good. Credits for an
+  // open channel are handed back in batches of half the receive window to keep the number of credit events down.
+  if (_channels == NULL || !_channels[channel].open)
+  {
+    sendChannelCredits(channel, 1);
+    return;
+  }
 
-#ifdef DEBUG
-  Serial.print(F("SET Role: "));
+  Channel &ch = _channels[channel];
 
-  if (success)
+  ch.consumed++;
+
+  if (ch.consumed >= max(1, ch.receiveWindow / 2))
   {
-    switch (role)
+    if (sendChannelCredits(channel, ch.consumed))
     {
-    case Role::Central:
-      Serial.println(F("Central"));
-      break;
-
-    case Role::Peripheral:
-      Serial.println(F("Peripheral"));
-      break;
+      ch.consumed = 0;
     }
   }
-  else
-  {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
-  }
+}
 
-  Serial.flush();
-#endif
+bool BondedHM10::sendChannelCredits(const uint8_t channel, const uint8_t credits)
+{
+  uint8_t content[2] = {channel, credits};
 
-  return success;
+  return writeControlEvent(CHANNEL_CREDIT_EVENT_ID, content, 2, NULL, 0);
 }
 
-bool BondedHM10::getBaudRate(BaudRate &baudRate)
+void BondedHM10::receiveChannelCredits(const uint8_t channel, const uint8_t credits)
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_BAUDRATE, true, NULL, RESPONSE_OKGET, _responseStr);
+  // The remote may open its end of a channel first, so the credits are kept for when this end is opened.
+  if (channel < MAX_CHANNELS && allocateChannels())
+  {
+    Channel &ch = _channels[channel];
 
-  if (success)
+    ch.credits = (uint8_t)min(255, ch.credits + credits);
+  }
+}
+
+bool BondedHM10::registerRpcMethod(const uint8_t method, RpcMethodDelegate methodHandler)
+{
+  if (!allocateRpcState())
   {
-    char *responseCode = (char *)calloc(2, sizeof(char));
+    return false;
+  }
 
-    parseCommandResponseValue(RESPONSE_OKGET, _responseStr, responseCode);
+  int8_t freeSlot = -1;
 
-    if (responseCode[0] == '0')
-    {
-      baudRate = BaudRate::Baud_9600;
-    }
-    else if (responseCode[0] == '1')
-    {
-      baudRate = BaudRate::Baud_19200;
-    }
-    else if (responseCode[0] == '2')
-    {
-      baudRate = BaudRate::Baud_38400;
-    }
-    else if (responseCode[0] == '3')
-    {
-      baudRate = BaudRate::Baud_57600;
-    }
-    else if (responseCode[0] == '4')
-    {
-      baudRate = BaudRate::Baud_115200;
-    }
-    else if (responseCode[0] == '5')
-    {
-      baudRate = BaudRate::Baud_4800;
-    }
-    else if (responseCode[0] == '6')
-    {
-      baudRate = BaudRate::Baud_2400;
-    }
-    else if (responseCode[0] == '7')
-    {
-      baudRate = BaudRate::Baud_1200;
-    }
-    else if (responseCode[0] == '8')
+  for (uint8_t i = 0; i < MAX_RPC_METHODS; i++)
+  {
+    if (_rpc->methods[i].handler != NULL && _rpc->methods[i].method == method)
     {
-      baudRate = BaudRate::Baud_230400;
+      // Re-registering a method replaces its handler (or unregisters it when NULL is given).
+      _rpc->methods[i].handler = methodHandler;
+      return true;
     }
-    else
+
+    if (_rpc->methods[i].handler == NULL && freeSlot < 0)
     {
-      success = false;
+      freeSlot = i;
     }
+  }
+
+  if (methodHandler == NULL)
+  {
+    return true;
+  }
+
+  if (freeSlot < 0)
+  {
+#ifdef DEBUG
+    Serial.println(F("No room left to register another RPC method."));
+#endif
 
-    free(responseCode);
+    return false;
   }
 
-#ifdef DEBUG
-  Serial.print(F("Baud Rate: "));
+  _rpc->methods[freeSlot].method = method;
+  _rpc->methods[freeSlot].handler = methodHandler;
 
-  if (success)
-  {
-    switch (baudRate)
-    {
-    case BaudRate::Baud_9600:
-      Serial.println(F("9600"));
-      break;
+  return true;
+}
 
-    case BaudRate::Baud_19200:
-      Serial.println(F("19200"));
-      break;
+uint8_t BondedHM10::callRpc(const uint8_t method, const uint8_t *content, const uint16_t length, RpcCompletedDelegate completedHandler, const unsigned long timeout)
+{
+  if (!allocateRpcState())
+  {
+    return 0;
+  }
 
-    case BaudRate::Baud_38400:
-      Serial.println(F("38400"));
-      break;
+  PendingRpcCall *call = NULL;
 
-    case BaudRate::Baud_57600:
-      Serial.println(F("57600"));
+  for (uint8_t i = 0; i < MAX_PENDING_RPC_CALLS; i++)
+  {
+    if (_rpc->pendingCalls[i].callID == 0)
+    {
+      call = &_rpc->pendingCalls[i];
       break;
+    }
+  }
 
-    case BaudRate::Baud_115200:
-      Serial.println(F("115200"));
-      break;
+  if (call == NULL)
+  {
+#ifdef DEBUG
+    Serial.println(F("Too many RPC calls in flight."));
+#endif
 
-    case BaudRate::Baud_4800:
-      Serial.println(F("4800"));
-      break;
+    return 0;
+  }
 
-    case BaudRate::Baud_2400:
-      Serial.println(F("2400"));
-      break;
+  // Call IDs run from 1 to 255 (0 means "no call"), skipping any that are still in flight.
+  uint8_t callID;
 
-    case BaudRate::Baud_1200:
-      Serial.println(F("1200"));
-      break;
+  do
+  {
+    callID = ++_rpc->lastCallID;
 
-    case BaudRate::Baud_230400:
-      Serial.println(F("23040"));
-      break;
+    if (callID == 0)
+    {
+      callID = _rpc->lastCallID = 1;
     }
-  }
-  else
+  } while (findPendingRpcCall(callID) != NULL);
+
+  uint8_t header[2] = {method, callID};
+
+  if (!writeControlEvent(RPC_REQUEST_EVENT_ID, header, 2, content, length))
   {
-    Serial.print(F("FAILURE: Unknown baud rate number. "));
-    Serial.println(_responseStr);
+    return 0;
   }
 
-  Serial.flush();
-#endif
+  call->callID = callID;
+  call->completedHandler = completedHandler;
+  call->startTime = millis();
+  call->timeout = timeout;
 
-  return success;
+  return callID;
 }
 
-bool BondedHM10::setBaudRate(const BaudRate baudRate)
+uint8_t BondedHM10::callRpc(const uint8_t method, const char *content, RpcCompletedDelegate completedHandler, const unsigned long timeout)
+{
+  return callRpc(method, (const uint8_t *)content, strlen(content), completedHandler, timeout);
+}
+
+bool BondedHM10::replyRpc(const uint8_t callID, const uint8_t *content, const uint16_t length)
 {
-  uint8_t baudRateInt = (uint8_t)baudRate;
-  char *baudRateStr = (char *)calloc(2, sizeof(char));
-  sprintf(baudRateStr, "%i", baudRateInt);
+  uint8_t header[2] = {callID, RpcStatus::Ok};
 
-  bool success = sendCommandWithExpectedResponse(COMMAND_BAUDRATE, false, baudRateStr, RESPONSE_OKSET, _responseStr);
+  return writeControlEvent(RPC_RESPONSE_EVENT_ID, header, 2, content, length);
+}
 
-  free(baudRateStr);
+bool BondedHM10::replyRpc(const uint8_t callID, const char *content)
+{
+  return replyRpc(callID, (const uint8_t *)content, strlen(content));
+}
 
-#ifdef DEBUG
-  Serial.print(F("SET Baud Rate: "));
+uint8_t BondedHM10::getPendingRpcCount()
+{
+  uint8_t count = 0;
 
-  if (success)
+  for (uint8_t i = 0; _rpc != NULL && i < MAX_PENDING_RPC_CALLS; i++)
   {
-    switch (baudRate)
+    if (_rpc->pendingCalls[i].callID != 0)
     {
-    case BaudRate::Baud_9600:
-      Serial.println(F("9600"));
-      break;
+      count++;
+    }
+  }
 
-    case BaudRate::Baud_19200:
-      Serial.println(F("19200"));
-      break;
+  return count;
+}
 
-    case BaudRate::Baud_38400:
-      Serial.println(F("38400"));
-      break;
+BondedHM10::PendingRpcCall *BondedHM10::findPendingRpcCall(const uint8_t callID)
+{
+  for (uint8_t i = 0; _rpc != NULL && i < MAX_PENDING_RPC_CALLS; i++)
+  {
+    if (_rpc->pendingCalls[i].callID == callID)
+    {
+      return &_rpc->pendingCalls[i];
+    }
+  }
 
-    case BaudRate::Baud_57600:
-      Serial.println(F("57600"));
-      break;
+  return NULL;
+}
 
-    case BaudRate::Baud_115200:
-      Serial.println(F("115200"));
-      break;
+void BondedHM10::completeRpcCall(PendingRpcCall *call, const RpcStatus status, const uint8_t *content, const uint16_t length)
+{
+  // The slot is freed before the handler is invoked so that the handler can make another call right away.
+  uint8_t callID = call->callID;
+  RpcCompletedDelegate completedHandler = call->completedHandler;
 
-    case BaudRate::Baud_4800:
-      Serial.println(F("4800"));
-      break;
+  call->callID = 0;
 
-    case BaudRate::Baud_2400:
-      Serial.println(F("2400"));
-      break;
+  if (completedHandler)
+  {
+    completedHandler(callID, status, content, length);
+  }
+}
 
-    case BaudRate::Baud_1200:
-      Serial.println(F("1200"));
-      break;
+void BondedHM10::checkRpcTimeouts()
+{
+  unsigned long now = millis();
 
-    case BaudRate::Baud_230400:
-      Serial.println(F("230400"));
-      break;
-    }
-  }
-  else
+  for (uint8_t i = 0; _rpc != NULL && i < MAX_PENDING_RPC_CALLS; i++)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
-  }
+    PendingRpcCall &call = _rpc->pendingCalls[i];
 
-  Serial.flush();
+    if (call.callID != 0 && (now - call.startTime) >= call.timeout)
+    {
+#ifdef DEBUG
+      Serial.print(F("RPC call "));
+      Serial.print(call.callID);
+      Serial.println(F(" timed out."));
 #endif
 
-  return success;
+      completeRpcCall(&call, RpcStatus::TimedOut, NULL, 0);
+    }
+  }
 }
 
-bool BondedHM10::getWorkType(WorkType &workType)
+void BondedHM10::failPendingRpcCalls(const RpcStatus status)
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_WORKTYPE, true, NULL, RESPONSE_OKGET, _responseStr);
+  for (uint8_t i = 0; _rpc != NULL && i < MAX_PENDING_RPC_CALLS; i++)
+  {
+    if (_rpc->pendingCalls[i].callID != 0)
+    {
+      completeRpcCall(&_rpc->pendingCalls[i], status, NULL, 0);
+    }
+  }
+}
 
-  if (success)
+void BondedHM10::dispatchRpcRequest(uint8_t *content, const uint16_t length)
+{
+  if (length < 2)
   {
-    char *responseCode = (char *)calloc(2, sizeof(char));
+    return;
+  }
 
-    parseCommandResponseValue(RESPONSE_OKGET, _responseStr, responseCode);
+  const uint8_t method = content[0];
+  const uint8_t callID = content[1];
 
-    if (responseCode[0] == '0')
-    {
-      workType = WorkType::AutoStart;
-    }
-    else if (responseCode[0] == '1')
-    {
-      workType = WorkType::ManualStart;
-    }
-    else
+  for (uint8_t i = 0; _rpc != NULL && i < MAX_RPC_METHODS; i++)
+  {
+    if (_rpc->methods[i].handler != NULL && _rpc->methods[i].method == method)
     {
-      success = false;
+      // The handler is expected to answer with replyRpc(), either right away or later on.
+      _rpc->methods[i].handler(method, callID, content + 2, length - 2);
+      return;
     }
+  }
+
+  uint8_t header[2] = {callID, RpcStatus::MethodNotFound};
 
-    free(responseCode);
+  writeControlEvent(RPC_RESPONSE_EVENT_ID, header, 2, NULL, 0);
+}
+
+void BondedHM10::dispatchRpcResponse(uint8_t *content, const uint16_t length)
+{
+  if (length < 2)
+  {
+    return;
   }
 
-#ifdef DEBUG
-  Serial.print(F("Work Type: "));
+  PendingRpcCall *call = findPendingRpcCall(content[0]);
 
-  if (success)
+  if (call == NULL || content[0] == 0)
   {
-    switch (workType)
-    {
-    case WorkType::AutoStart:
-      Serial.println(F("Auto Start"));
-      break;
+    // The call already timed out (or was never made), so the late response is ignored.
+    return;
+  }
 
-    case WorkType::ManualStart:
-      Serial.println(F("Manual Start"));
-      break;
+  completeRpcCall(call, (RpcStatus)content[1], content + 2, length - 2);
+}
+
+uint16_t BondedHM10::updateBlobChecksum(uint16_t crc, const uint8_t *content, const uint16_t length)
+{
+  // CRC-16/CCITT, computed a byte at a time so no lookup table is needed.
+  for (uint16_t i = 0; i < length; i++)
+  {
+    crc ^= ((uint16_t)content[i] << 8);
+
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = ((crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1));
     }
   }
-  else
+
+  return crc;
+}
+
+void BondedHM10::writeUInt32(uint8_t *destination, const uint32_t value)
+{
+  destination[0] = (uint8_t)value;
+  destination[1] = (uint8_t)(value >> 8);
+  destination[2] = (uint8_t)(value >> 16);
+  destination[3] = (uint8_t)(value >> 24);
+}
+
+uint32_t BondedHM10::readUInt32(const uint8_t *source)
+{
+  return ((uint32_t)source[0] | ((uint32_t)source[1] << 8) | ((uint32_t)source[2] << 16) | ((uint32_t)source[3] << 24));
+}
+
+bool BondedHM10::sendBlob(const uint32_t size, BlobReadDelegate blobReadHandler)
+{
+  if (size == 0 || blobReadHandler == NULL || !allocateBlobState() || _blob->sending)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    return false;
   }
 
-  Serial.flush();
-#endif
+  if (!_blob->transferIDSeeded)
+  {
+    // Transfer IDs start from a different value after every reset. Otherwise a receiver still holding a transfer
+    // from before the reset would take the new one for it and resume it.
+    _blob->transferID = (uint8_t)micros();
+    _blob->transferIDSeeded = true;
+  }
 
-  delay(500); // Delay is apparently needed as the next AT command after this will fail if started within 0.5 seconds.
-  return success;
+  _blob->sending = true;
+  _blob->started = false;
+  _blob->endSent = false;
+  _blob->transferID++;
+  _blob->size = size;
+  _blob->ackedOffset = 0;
+  _blob->nextOffset = 0;
+  _blob->checksumOffset = 0;
+  _blob->checksum = BLOB_CHECKSUM_SEED;
+  _blob->chunkSize = 0;
+  _blob->timeoutCount = 0;
+  _blob->readHandler = blobReadHandler;
+  _blob->lastAckTime = millis() - BLOB_ACK_TIMEOUT; // Send the start straight away.
+
+  return true;
 }
 
-bool BondedHM10::setWorkType(const WorkType workType)
+bool BondedHM10::isSendingBlob()
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_WORKTYPE, false, (workType == WorkType::AutoStart ? "0" : "1"), RESPONSE_OKSET, _responseStr);
+  return (_blob != NULL && _blob->sending);
+}
 
-#ifdef DEBUG
-  Serial.print(F("SET Device Work Type: "));
+void BondedHM10::cancelBlob()
+{
+  if (_blob != NULL)
+  {
+    _blob->sending = false;
+  }
+}
 
-  if (success)
+void BondedHM10::setBlobWriteHandler(BlobWriteDelegate blobWriteHandler)
+{
+  _blobWriteHandler = blobWriteHandler;
+}
+
+void BondedHM10::setBlobProgressHandler(BlobProgressDelegate blobProgressHandler)
+{
+  _blobProgressHandler = blobProgressHandler;
+}
+
+void BondedHM10::setBlobCompletedHandler(BlobCompletedDelegate blobCompletedHandler)
+{
+  _blobCompletedHandler = blobCompletedHandler;
+}
+
+void BondedHM10::serviceBlobTransfer()
+{
+  if (_blob == NULL || !_blob->sending || !_connected)
+  {
+    return;
+  }
+
+  unsigned long now = millis();
+
+  if (!_blob->started || _blob->endSent)
   {
-    switch (workType)
+    // Waiting on the receiver to answer the start (with the offset to resume from) or the end (with the result of
+    // the checksum comparison). Both are repeated until the answer arrives, or until it is clear it never will.
+    if ((now - _blob->lastAckTime) >= BLOB_ACK_TIMEOUT)
     {
-    case WorkType::AutoStart:
-      Serial.println(F("Auto Start"));
-      break;
+      if (++_blob->timeoutCount > BLOB_MAX_TIMEOUTS)
+      {
+        failBlobTransfer(BlobTimedOut);
+        return;
+      }
 
-    case WorkType::ManualStart:
-      Serial.println(F("Manual Start"));
-      break;
+      _blob->lastAckTime = now;
+
+      if (_blob->endSent)
+      {
+        uint8_t header[3] = {_blob->transferID, lowByte(_blob->checksum), highByte(_blob->checksum)};
+        writeControlEvent(BLOB_END_EVENT_ID, header, 3, NULL, 0);
+      }
+      else
+      {
+        uint8_t header[5] = {_blob->transferID};
+        writeUInt32(header + 1, _blob->size);
+        writeControlEvent(BLOB_START_EVENT_ID, header, 5, NULL, 0);
+      }
     }
+
+    return;
   }
-  else
+
+  if (_blob->checksumOffset < _blob->nextOffset)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
-  }
+    // The receiver resumed from further on than this side has sent, having taken this transfer for one from before
+    // a reset. The content it already has is read back first, a chunk per pass through loop(), so the checksum
+    // still covers the whole blob. Nothing is outstanding in the meantime, so the receiver isn't waited on either.
+    uint8_t chunk[BLOB_CHUNK_SIZE];
+    uint16_t length = (uint16_t)min((uint32_t)BLOB_CHUNK_SIZE, _blob->nextOffset - _blob->checksumOffset);
 
-  Serial.flush();
+    if (_blob->readHandler(_blob->checksumOffset, chunk, length) != length)
+    {
+#ifdef DEBUG
+      Serial.println(F("Blob source failed to provide content. Transfer cancelled."));
 #endif
 
-  delay(500); // Delay is apparently needed as the next AT command after this will fail if started within 0.5 seconds.
-  return success;
-}
+      failBlobTransfer(BlobFailed);
+      return;
+    }
 
-bool BondedHM10::getLastConnectedAddress(char *address)
-{
-  bool success = sendCommandWithExpectedResponse(COMMAND_RADD, true, NULL, RADD_RESPONSE, _responseStr);
+    _blob->checksum = updateBlobChecksum(_blob->checksum, chunk, length);
+    _blob->checksumOffset += length;
+    _blob->lastAckTime = now;
+    return;
+  }
 
-  if (success)
+  if (_blob->ackedOffset == _blob->size)
   {
-    parseCommandResponseValue(RADD_RESPONSE, _responseStr, address);
+    _blob->endSent = true;
+    _blob->timeoutCount = 0;
+    _blob->lastAckTime = now - BLOB_ACK_TIMEOUT;
+    return;
   }
 
-#ifdef DEBUG
-  Serial.print(F("Last Connected Address: "));
-
-  if (success)
+  if ((now - _blob->lastAckTime) >= BLOB_ACK_TIMEOUT)
   {
-    Serial.println(address);
+    // Nothing has been acknowledged for a while, so go back and send everything after the last acknowledged
+    // offset again.
+    if (++_blob->timeoutCount > BLOB_MAX_TIMEOUTS)
+    {
+      failBlobTransfer(BlobTimedOut);
+      return;
+    }
+
+    _blob->nextOffset = _blob->ackedOffset;
+    _blob->lastAckTime = now;
   }
-  else
+
+  if (_blob->nextOffset >= _blob->size || (_blob->nextOffset - _blob->ackedOffset) >= ((uint32_t)_blob->chunkSize * BLOB_WINDOW_SIZE))
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    return;
   }
 
-  Serial.flush();
+  // One chunk is sent per pass through loop().
+  uint8_t header[BLOB_CHUNK_HEADER_SIZE];
+  uint8_t chunk[BLOB_CHUNK_SIZE];
+  uint16_t length = (uint16_t)min((uint32_t)_blob->chunkSize, _blob->size - _blob->nextOffset);
+
+  if (_blob->readHandler(_blob->nextOffset, chunk, length) != length)
+  {
+#ifdef DEBUG
+    Serial.println(F("Blob source failed to provide content. Transfer cancelled."));
 #endif
 
-  if (!success)
+    failBlobTransfer(BlobFailed);
+    return;
+  }
+
+  if (_blob->nextOffset == _blob->checksumOffset)
   {
-    clearString(address);
+    // The checksum is built up as the content is sent for the first time, rather than reading the whole blob up
+    // front. Chunks that are sent again don't change it.
+    _blob->checksum = updateBlobChecksum(_blob->checksum, chunk, length);
+    _blob->checksumOffset += length;
   }
 
-  return success;
+  writeUInt32(header, _blob->nextOffset);
+
+  if (writeControlEvent(BLOB_CHUNK_EVENT_ID, header, BLOB_CHUNK_HEADER_SIZE, chunk, length))
+  {
+    _blob->nextOffset += length;
+  }
 }
 
-bool BondedHM10::clearLastConnectedAddress()
+void BondedHM10::dispatchBlobEvent(const uint16_t id, uint8_t *content, const uint16_t length)
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_CLEAR, false, NULL, CLEAR_RESPONSE, _responseStr);
+  // Only the start of a transfer by the remote allocates the state. Anything else is for a transfer this side has
+  // never taken part in.
+  if (_blob == NULL && (id != BLOB_START_EVENT_ID || !allocateBlobState()))
+  {
+    return;
+  }
 
-#ifdef DEBUG
-  if (success)
+  if (id == BLOB_START_EVENT_ID && length >= 5)
   {
-    Serial.println(F("Last connected address cleared."));
+    uint32_t size = readUInt32(content + 1);
+
+    if (!_blob->receiving || content[0] != _blob->receiveID || size != _blob->receiveSize)
+    {
+      // A new transfer. Otherwise this is the same transfer being resumed after a reconnect, and it carries on
+      // from what has already been received.
+      _blob->receiving = true;
+      _blob->receiveID = content[0];
+      _blob->receiveSize = size;
+      _blob->receivedOffset = 0;
+      _blob->receiveChecksum = BLOB_CHECKSUM_SEED;
+    }
+
+    sendBlobAck();
   }
-  else
+  else if (id == BLOB_CHUNK_EVENT_ID && length > BLOB_CHUNK_HEADER_SIZE)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    if (!_blob->receiving)
+    {
+      return;
+    }
+
+    uint32_t offset = readUInt32(content);
+    uint16_t chunkLength = length - BLOB_CHUNK_HEADER_SIZE;
+
+    if (offset == _blob->receivedOffset && (offset + chunkLength) <= _blob->receiveSize && (!_blobWriteHandler || _blobWriteHandler(offset, content + BLOB_CHUNK_HEADER_SIZE, chunkLength)))
+    {
+      _blob->receiveChecksum = updateBlobChecksum(_blob->receiveChecksum, content + BLOB_CHUNK_HEADER_SIZE, chunkLength);
+      _blob->receivedOffset += chunkLength;
+      _blob->chunksSinceAck = (_blob->chunksSinceAck == BLOB_OUT_OF_ORDER ? 1 : _blob->chunksSinceAck + 1);
+
+      if (_blobProgressHandler)
+      {
+        _blobProgressHandler(false, _blob->receivedOffset, _blob->receiveSize);
+      }
+
+      // Acknowledgements are cumulative, so one is only sent for every half window of chunks received.
+      if (_blob->chunksSinceAck >= max(1, BLOB_WINDOW_SIZE / 2) || _blob->receivedOffset == _blob->receiveSize)
+      {
+        sendBlobAck();
+      }
+    }
+    else if (_blob->chunksSinceAck != BLOB_OUT_OF_ORDER)
+    {
+      // A chunk went missing. Let the sender know where to go back to (just once, rather than for every chunk
+      // in the rest of the window).
+      sendBlobAck();
+      _blob->chunksSinceAck = BLOB_OUT_OF_ORDER;
+    }
   }
+  else if (id == BLOB_ACK_EVENT_ID && length >= 4)
+  {
+    uint32_t offset = readUInt32(content);
 
-  Serial.flush();
-#endif
+    // Acknowledgements still on their way for a transfer from before a reset are ignored.
+    if (!_blob->sending || offset > _blob->size || (length >= 7 && content[6] != _blob->transferID))
+    {
+      return;
+    }
+
+    if (!_blob->started)
+    {
+      _blob->started = true;
+      _blob->ackedOffset = offset;
+      _blob->nextOffset = offset;
+    }
+    else if (offset > _blob->ackedOffset && offset <= _blob->nextOffset)
+    {
+      _blob->ackedOffset = offset;
+    }
+    else
+    {
+      return;
+    }
 
-  return success;
-}
+    // Chunks are kept small enough for both sides. Receivers that don't say how much they can take get the full
+    // size.
+    uint16_t chunkSize = min(BLOB_CHUNK_SIZE, (uint16_t)(_maxContentLength - BLOB_CHUNK_HEADER_SIZE));
 
-bool BondedHM10::getWhitelistEnabled(bool &enabled)
-{
-  bool success = sendCommandWithExpectedResponse(COMMAND_WHITELISTENABLED, true, NULL, RESPONSE_OKGET, _responseStr);
+    if (length >= 6)
+    {
+      chunkSize = min(chunkSize, (uint16_t)word(content[5], content[4]));
+    }
 
-  if (success)
+    _blob->chunkSize = max(chunkSize, (uint16_t)1);
+    _blob->timeoutCount = 0;
+    _blob->lastAckTime = millis();
+
+    if (_blobProgressHandler)
+    {
+      _blobProgressHandler(true, _blob->ackedOffset, _blob->size);
+    }
+  }
+  else if (id == BLOB_END_EVENT_ID && length >= 3)
   {
-    char *responseCode = (char *)calloc(2, sizeof(char));
+    if (content[0] != _blob->receiveID)
+    {
+      return;
+    }
 
-    parseCommandResponseValue(RESPONSE_OKGET, _responseStr, responseCode);
+    bool completed = _blob->receiving;
 
-    if (responseCode[0] == '0')
+    if (_blob->receiving)
     {
-      enabled = false;
+      _blob->receiveSucceeded = (_blob->receivedOffset == _blob->receiveSize && _blob->receiveChecksum == (uint16_t)word(content[2], content[1]));
+      _blob->receiving = false;
     }
-    else if (responseCode[0] == '1')
+
+    // The result is sent again if the end is repeated (because the first result was lost).
+    uint8_t header[2] = {_blob->receiveID, _blob->receiveSucceeded};
+    writeControlEvent(BLOB_RESULT_EVENT_ID, header, 2, NULL, 0);
+
+    if (completed && _blobCompletedHandler)
     {
-      enabled = true;
+      _blobCompletedHandler(false, (_blob->receiveSucceeded ? BlobSucceeded : BlobFailed));
     }
-    else
+  }
+  else if (id == BLOB_RESULT_EVENT_ID && length >= 2)
+  {
+    if (!_blob->sending || !_blob->endSent || content[0] != _blob->transferID)
     {
-      success = false;
+      return;
     }
 
-    free(responseCode);
+    _blob->sending = false;
+
+    if (_blobCompletedHandler)
+    {
+      _blobCompletedHandler(true, (content[1] != 0 ? BlobSucceeded : BlobFailed));
+    }
   }
+}
 
-#ifdef DEBUG
-  Serial.print(F("Whitelist Enabled: "));
+void BondedHM10::failBlobTransfer(const BlobStatus status)
+{
+  _blob->sending = false;
 
-  if (success)
-  {
-    Serial.println((enabled ? F("Yes") : F("No")));
-  }
-  else
+  if (_blobCompletedHandler)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    _blobCompletedHandler(true, status);
   }
-
-  Serial.flush();
-#endif
-
-  return success;
 }
 
-bool BondedHM10::setWhitelistEnabled(const bool enabled)
+void BondedHM10::sendBlobAck()
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_WHITELISTENABLED, false, (enabled ? "1" : "0"), RESPONSE_OKSET, _responseStr);
+  // Along with the offset received so far, the receiver says how much chunk content fits in its receive buffer, and
+  // which transfer the acknowledgement is for.
+  uint8_t header[7];
+  uint16_t capacity = (_maxContentLength > BLOB_CHUNK_HEADER_SIZE ? _maxContentLength - BLOB_CHUNK_HEADER_SIZE : 1);
 
-#ifdef DEBUG
-  Serial.print(F("SET Whitelist Enabled: "));
+  writeUInt32(header, _blob->receivedOffset);
+  header[4] = lowByte(capacity);
+  header[5] = highByte(capacity);
+  header[6] = _blob->receiveID;
 
-  if (success)
-  {
-    Serial.println((enabled ? F("Yes") : F("No")));
-  }
-  else
+  if (writeControlEvent(BLOB_ACK_EVENT_ID, header, 7, NULL, 0))
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    _blob->chunksSinceAck = 0;
   }
+}
 
-  Serial.flush();
-#endif
-
-  return success;
+void BondedHM10::setEventReceivedHandler(EventReceivedUInt8Delegate eventReceivedHandler)
+{
+  _eventReceivedUInt8Handler = eventReceivedHandler;
 }
 
-bool BondedHM10::getWhitelistAddress(const WhitelistSlot slot, char *address)
+void BondedHM10::setEventReceivedHandler(EventReceivedCharDelegate eventReceivedHandler)
 {
-  uint8_t slotInt = (uint8_t)slot;
-  char *whitelistStr = (char *)calloc(3, sizeof(char));
-  sprintf(whitelistStr, "%i?", slotInt);
+  _eventReceivedCharHandler = eventReceivedHandler;
+}
 
-  char *responseStr = (char *)calloc(strlen(WHITELIST_RESPONSE) + 3, sizeof(char));
-  sprintf(responseStr, "%s%i?:", WHITELIST_RESPONSE, slotInt);
+bool BondedHM10::writeMessage(const uint8_t *content, const uint16_t length)
+{
+  return writeMessage(content, length, Priority::High);
+}
 
-  bool success = sendCommandWithExpectedResponse(COMMAND_WHITELIST, true, whitelistStr, responseStr, _responseStr);
+bool BondedHM10::writeMessage(const char *content)
+{
+  return writeMessage(content, strlen(content));
+}
 
-  free(whitelistStr);
+bool BondedHM10::writeMessage(const char *content, const uint16_t length)
+{
+  return writeMessage((const uint8_t *)content, length);
+}
 
-  if (success)
-  {
-    parseCommandResponseValue(responseStr, _responseStr, address);
-  }
+bool BondedHM10::writeMessage(const __FlashStringHelper *content)
+{
+  return writeMessage(content, Priority::High);
+}
 
-  free(responseStr);
+bool BondedHM10::writeMessage(const uint8_t *content, const uint16_t length, const Priority priority)
+{
+  return writeFrame(false, 0, content, length, false, priority);
+}
 
-#ifdef DEBUG
-  Serial.print(F("Whitelist Address: "));
+bool BondedHM10::writeMessage(const char *content, const Priority priority)
+{
+  return writeMessage((const uint8_t *)content, strlen(content), priority);
+}
 
-  if (success)
-  {
-    switch (slot)
-    {
-    case WhitelistSlot::Slot1:
-      Serial.print(F("(Slot1) "));
-      break;
+bool BondedHM10::writeMessage(const __FlashStringHelper *content, const Priority priority)
+{
+  return writeFrame(false, 0, (const uint8_t *)content, getFlashStringHelperLength(content), true, priority);
+}
 
-    case WhitelistSlot::Slot2:
-      Serial.print(F("(Slot2) "));
-      break;
+void BondedHM10::setMessageReceivedHandler(MessageReceivedUInt8Delegate messageReceivedHandler)
+{
+  _messageReceivedUInt8Handler = messageReceivedHandler;
+}
 
-    case WhitelistSlot::Slot3:
-      Serial.print(F("(Slot3) "));
-      break;
-    }
+void BondedHM10::setMessageReceivedHandler(MessageReceivedCharDelegate messageReceivedHandler)
+{
+  _messageReceivedCharHandler = messageReceivedHandler;
+}
 
-    Serial.println(address);
-  }
-  else
+bool BondedHM10::setOfflineQueueEnabled(const bool enabled)
+{
+  if (enabled && _offlineQueueBuffer == NULL)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    // Only allocated when the offline queue is first enabled, so sketches that never use it don't pay for it.
+    _offlineQueueBuffer = (uint8_t *)allocate(_offlineQueueSize, sizeof(uint8_t));
+
+    if (_offlineQueueBuffer == NULL)
+    {
+      return false;
+    }
   }
 
-  Serial.flush();
-#endif
+  _offlineQueueEnabled = enabled;
 
-  return success;
+  return true;
 }
 
-bool BondedHM10::setWhitelistAddress(const WhitelistSlot slot, const char *address)
+bool BondedHM10::getOfflineQueueEnabled()
 {
-  uint8_t slotInt = (uint8_t)slot;
-  char *whitelistStr = (char *)calloc(14, sizeof(char));
-  sprintf(whitelistStr, "%i%s", slotInt, address);
-
-  bool success = sendCommandWithExpectedResponse(COMMAND_WHITELIST, false, whitelistStr, WHITELIST_RESPONSE, _responseStr);
+  return _offlineQueueEnabled;
+}
 
-  free(whitelistStr);
+BondedHM10::OfflineQueuePolicy BondedHM10::getOfflineQueuePolicy()
+{
+  return _offlineQueuePolicy;
+}
 
-#ifdef DEBUG
-  Serial.print(F("SET Whitelist Address: "));
+void BondedHM10::setOfflineQueuePolicy(const OfflineQueuePolicy policy)
+{
+  _offlineQueuePolicy = policy;
+}
 
-  if (success)
+bool BondedHM10::setOfflineQueueEepromSpill(const uint16_t address, const uint16_t size)
+{
+  if (_offlineQueueItemCount > 0)
   {
-    switch (slot)
-    {
-    case WhitelistSlot::Slot1:
-      Serial.print(F("(Slot1) "));
-      break;
-
-    case WhitelistSlot::Slot2:
-      Serial.print(F("(Slot2) "));
-      break;
-
-    case WhitelistSlot::Slot3:
-      Serial.print(F("(Slot3) "));
-      break;
-    }
+#ifdef DEBUG
+    Serial.println(F("The EEPROM spill area can only be changed while the offline queue is empty."));
+#endif
 
-    Serial.println(address);
-  }
-  else
-  {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    return false;
   }
 
-  Serial.flush();
-#endif
+  _offlineQueueEepromAddress = address;
+  _offlineQueueEepromSize = size;
+  _offlineQueueHead = 0;
 
-  return success;
+  return true;
 }
 
-bool BondedHM10::getBondMode(BondMode &bondMode)
+uint16_t BondedHM10::getOfflineQueueCount()
 {
-  bool success = sendCommandWithExpectedResponse(COMMAND_BONDMODE, true, NULL, RESPONSE_OKGET, _responseStr);
-
-  if (success)
-  {
-    char *responseCode = (char *)calloc(2, sizeof(char));
+  return _offlineQueueItemCount;
+}
 
-    parseCommandResponseValue(RESPONSE_OKGET, _responseStr, responseCode);
+uint32_t BondedHM10::getOfflineQueueDroppedCount()
+{
+  return _offlineQueueDroppedCount;
+}
 
-    if (responseCode[0] == '0')
-    {
-      bondMode = BondMode::NoAuth;
-    }
-    else if (responseCode[0] == '1')
-    {
-      bondMode = BondMode::AuthNoPin;
-    }
-    else if (responseCode[0] == '2')
-    {
-      bondMode = BondMode::AuthWithPin;
-    }
-    else if (responseCode[0] == '3')
-    {
-      bondMode = BondMode::AuthAndBond;
-    }
-    else
-    {
-      success = false;
-    }
+void BondedHM10::clearOfflineQueue()
+{
+  _offlineQueueSentOffset = 0;
+  _offlineQueueHead = 0;
+  _offlineQueueUsed = 0;
+  _offlineQueueItemCount = 0;
+}
 
-    free(responseCode);
-  }
+uint16_t BondedHM10::getOfflineQueueCapacity()
+{
+  return (_offlineQueueBuffer != NULL ? _offlineQueueSize : 0) + _offlineQueueEepromSize;
+}
 
-#ifdef DEBUG
-  Serial.print(F("Bond Mode: "));
+uint8_t BondedHM10::readOfflineQueueByte(const uint16_t position)
+{
+  // The queue is a ring over the RAM buffer followed by the EEPROM spill area (if any).
+  uint16_t index = (_offlineQueueHead + position) % getOfflineQueueCapacity();
 
-  if (success)
+  if (index < _offlineQueueSize)
   {
-    switch (bondMode)
-    {
-    case BondMode::NoAuth:
-      Serial.println(F("No Auth"));
-      break;
+    return _offlineQueueBuffer[index];
+  }
 
-    case BondMode::AuthNoPin:
-      Serial.println(F("Auth with no PIN"));
-      break;
+  return EEPROM.read(_offlineQueueEepromAddress + (index - _offlineQueueSize));
+}
 
-    case BondMode::AuthWithPin:
-      Serial.println(F("Auth with PIN"));
-      break;
+void BondedHM10::writeOfflineQueueByte(const uint16_t position, const uint8_t value)
+{
+  uint16_t index = (_offlineQueueHead + position) % getOfflineQueueCapacity();
 
-    case BondMode::AuthAndBond:
-      Serial.println(F("Auth and Bond"));
-      break;
-    }
+  if (index < _offlineQueueSize)
+  {
+    _offlineQueueBuffer[index] = value;
   }
   else
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    EEPROM.update(_offlineQueueEepromAddress + (index - _offlineQueueSize), value);
   }
+}
 
-  Serial.flush();
-#endif
-
-  return success;
+uint16_t BondedHM10::getOfflineQueueItemSize(const uint16_t position)
+{
+  return QUEUE_ITEM_HEADER_SIZE + (uint16_t)word(readOfflineQueueByte(position + 4), readOfflineQueueByte(position + 3));
 }
 
-bool BondedHM10::setBondMode(const BondMode bondMode)
+void BondedHM10::dropOldestOfflineQueueItem()
 {
-  uint8_t bondModeInt = (uint8_t)bondMode;
-  char *bondModeStr = (char *)calloc(2, sizeof(char));
-  sprintf(bondModeStr, "%i", bondModeInt);
+  uint16_t itemSize = getOfflineQueueItemSize(0);
 
-  bool success = sendCommandWithExpectedResponse(COMMAND_BONDMODE, false, bondModeStr, RESPONSE_OKSET, _responseStr);
+  _offlineQueueHead = (_offlineQueueHead + itemSize) % getOfflineQueueCapacity();
+  _offlineQueueUsed -= itemSize;
+  _offlineQueueItemCount--;
+}
 
-  free(bondModeStr);
+bool BondedHM10::queueOfflineFrame(const bool isEvent, const uint16_t id, const uint8_t *content, const uint16_t length, const bool contentInFlash)
+{
+  const uint16_t capacity = getOfflineQueueCapacity();
+  const uint16_t itemSize = QUEUE_ITEM_HEADER_SIZE + length;
 
+  if (itemSize > capacity || (_offlineQueuePolicy == OfflineQueuePolicy::DropNewest && itemSize > (capacity - _offlineQueueUsed)))
+  {
 #ifdef DEBUG
-  Serial.print(F("SET Bond Mode: "));
+    Serial.println(F("Offline queue full. Frame dropped."));
+#endif
 
-  if (success)
+    _offlineQueueDroppedCount++;
+    return false;
+  }
+
+  while (itemSize > (capacity - _offlineQueueUsed))
   {
-    switch (bondMode)
+    if (_offlineQueueSentOffset > 0)
     {
-    case BondMode::NoAuth:
-      Serial.println(F("No Auth"));
-      break;
+      // The oldest frame is part way through being sent, so it can't be dropped without breaking up the frame.
+      _offlineQueueDroppedCount++;
+      return false;
+    }
 
-    case BondMode::AuthNoPin:
-      Serial.println(F("Auth with no PIN"));
-      break;
+#ifdef DEBUG
+    Serial.println(F("Offline queue full. Oldest frame dropped."));
+#endif
 
-    case BondMode::AuthWithPin:
-      Serial.println(F("Auth with PIN"));
-      break;
+    dropOldestOfflineQueueItem();
+    _offlineQueueDroppedCount++;
+  }
 
-    case BondMode::AuthAndBond:
-      Serial.println(F("Auth and Bond"));
-      break;
-    }
+  // Each item is stored as a 1 byte frame type, the 2 byte ID, the 2 byte length, the 4 byte time it was
+  // queued at and then the content.
+  uint16_t position = _offlineQueueUsed;
+  const unsigned long timestamp = millis();
+
+  writeOfflineQueueByte(position++, (isEvent ? 1 : 0));
+  writeOfflineQueueByte(position++, lowByte(id));
+  writeOfflineQueueByte(position++, highByte(id));
+  writeOfflineQueueByte(position++, lowByte(length));
+  writeOfflineQueueByte(position++, highByte(length));
+
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    writeOfflineQueueByte(position++, (uint8_t)(timestamp >> (8 * i)));
   }
-  else
+
+  for (uint16_t i = 0; i < length; i++)
   {
-    Serial.print(F("FAILURE: "));
-    Serial.println(_responseStr);
+    writeOfflineQueueByte(position++, (contentInFlash ? pgm_read_byte(content + i) : content[i]));
   }
 
-  Serial.flush();
-#endif
+  _offlineQueueUsed += itemSize;
+  _offlineQueueItemCount++;
 
-  return success;
+  return true;
 }
 
-#ifdef DEBUG
-void BondedHM10::printDeviceConfig()
+unsigned long BondedHM10::getOfflineQueueItemTimestamp()
 {
-  delay(500);
+  unsigned long timestamp = 0;
 
-  char *configStr = (char *)calloc(32, sizeof(char));
-  bool configBool = false;
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    timestamp |= ((unsigned long)readOfflineQueueByte(5 + i) << (8 * i));
+  }
 
-  getDeviceName(configStr);
-  getFirmwareVersion(configStr);
+  return timestamp;
+}
 
-  BaudRate baudRate = BaudRate::Baud_Default;
-  getBaudRate(baudRate);
+uint16_t BondedHM10::sendOfflineQueueFragment()
+{
+  if (!_connected || _offlineQueueItemCount == 0)
+  {
+    return 0;
+  }
 
-  BondMode bondMode = BondMode::NoAuth;
-  getBondMode(bondMode);
+  const bool isEvent = (readOfflineQueueByte(0) == 1);
+  const uint16_t id = (uint16_t)word(readOfflineQueueByte(2), readOfflineQueueByte(1));
+  const uint16_t itemSize = getOfflineQueueItemSize(0);
+  const uint16_t remaining = itemSize - QUEUE_ITEM_HEADER_SIZE - _offlineQueueSentOffset;
+  const uint16_t fragmentLength = min(remaining, FRAGMENT_SIZE);
+  uint16_t lengthField = fragmentLength;
 
-  getAddress(configStr);
+  if (fragmentLength < remaining)
+  {
+    lengthField |= FRAGMENT_MORE_FLAG;
+  }
 
-  Role role = Role::Central;
-  getRole(role);
+  if (_offlineQueueSentOffset > 0)
+  {
+    lengthField |= FRAGMENT_CONTINUATION_FLAG;
+  }
 
-  WorkType workType = WorkType::AutoStart;
-  getWorkType(workType);
+  if (_dataTransmittedOutputPin >= 0)
+  {
+    startTransmissionTimer();
+  }
 
-  getWhitelistEnabled(configBool);
-  getWhitelistAddress(WhitelistSlot::DefaultSlot, configStr);
+  // Frames from the queue are stamped with the time they were queued, so the receiver sees the full delay.
+  writeFrameHeader(isEvent, id, lengthField, getOfflineQueueItemTimestamp());
 
-  free(configStr);
-}
-#endif
+  uint16_t position = QUEUE_ITEM_HEADER_SIZE + _offlineQueueSentOffset;
 
-uint16_t BondedHM10::getFlashStringHelperLength(const __FlashStringHelper *content)
-{
-  PGM_P p = reinterpret_cast<PGM_P>(content);
-  uint16_t length = 0;
+  for (uint16_t i = 0; i < fragmentLength; i++)
+  {
+    _stream->write(readOfflineQueueByte(position++));
+  }
 
-  while (true)
+  _offlineQueueSentOffset += fragmentLength;
+
+  if (fragmentLength == remaining)
   {
-    unsigned char c = pgm_read_byte(p++);
+    updateSendLatencyMetrics(Priority::Low, millis() - getOfflineQueueItemTimestamp());
+    dropOldestOfflineQueueItem();
+    _offlineQueueSentOffset = 0;
 
-    if (c == 0)
+    if (_offlineQueueItemCount == 0)
     {
-      break;
+      // Start over at the beginning of the RAM buffer so the EEPROM spill area is only touched when the RAM buffer overflows.
+      clearOfflineQueue();
     }
-
-    length++;
   }
 
-  return length;
+  return fragmentLength;
 }
 
-void BondedHM10::writeFlashStringHelperContent(const __FlashStringHelper *content)
+bool BondedHM10::queueLowPriorityFrame(const bool isEvent, const uint16_t id, const uint8_t *content, const uint16_t length, const bool contentInFlash)
 {
-  PGM_P p = reinterpret_cast<PGM_P>(content);
+  // Low priority frames written while connected wait here rather than in the offline queue, which is only for
+  // frames written while disconnected. There is always room for a frame of the max content length, and nothing is
+  // dropped: when a new frame doesn't fit, the frames ahead of it are sent until it does.
+  const uint16_t capacity = _maxContentLength + QUEUE_ITEM_HEADER_SIZE;
+  const uint16_t itemSize = QUEUE_ITEM_HEADER_SIZE + length;
 
-  while (true)
+  if (_lowPriorityQueueBuffer == NULL)
   {
-    uint8_t c = (uint8_t)pgm_read_byte(p++);
+    // Only allocated the first time a low priority frame is written.
+    _lowPriorityQueueBuffer = (uint8_t *)allocate(capacity, sizeof(uint8_t));
 
-    if (c == 0 || !_stream->write(c))
+    if (_lowPriorityQueueBuffer == NULL)
     {
-      break;
+      return false;
     }
   }
-}
 
-bool BondedHM10::writeEvent(uint16_t id, const uint8_t *content, const uint16_t length)
-{
-  bool success = true;
-
-  if (_initialized && _connected)
+  while (itemSize > (capacity - _lowPriorityQueueUsed))
   {
-    if (length > MAX_CONTENT_BUFFER_SIZE)
+    if (sendQueuedFragment() == 0)
     {
-#ifdef DEBUG
-      Serial.print(F("The length of event content provided ("));
-      Serial.print(length);
-      Serial.print(F(" bytes) surpasses the max length of "));
-      Serial.print(MAX_CONTENT_BUFFER_SIZE);
-      Serial.println(F(" bytes allowed for events."));
-#endif
-
-      success = false;
+      return false;
     }
-    else
-    {
-      if (_dataTransmittedOutputPin >= 0)
-      {
-        startTransmissionTimer();
-      }
+  }
 
-      _stream->write(EVENT_PREFIX, PREFIX_LEN);
-      _stream->write(lowByte(id));
-      _stream->write(highByte(id));
-      _stream->write(lowByte(length));
-      _stream->write(highByte(length));
-      _stream->write(content, length);
-    }
+  // Items are laid out the same way as in the offline queue.
+  uint16_t position = _lowPriorityQueueUsed;
+  const unsigned long timestamp = millis();
+
+  writeLowPriorityQueueByte(position++, (isEvent ? 1 : 0));
+  writeLowPriorityQueueByte(position++, lowByte(id));
+  writeLowPriorityQueueByte(position++, highByte(id));
+  writeLowPriorityQueueByte(position++, lowByte(length));
+  writeLowPriorityQueueByte(position++, highByte(length));
+
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    writeLowPriorityQueueByte(position++, (uint8_t)(timestamp >> (8 * i)));
   }
-  else
+
+  for (uint16_t i = 0; i < length; i++)
   {
-    success = false;
+    writeLowPriorityQueueByte(position++, (contentInFlash ? pgm_read_byte(content + i) : content[i]));
   }
 
-  return success;
+  _lowPriorityQueueUsed += itemSize;
+
+  return true;
 }
 
-bool BondedHM10::writeEvent(uint16_t id, const char *content)
+uint8_t BondedHM10::readLowPriorityQueueByte(const uint16_t position)
 {
-  return writeEvent(id, content, strlen(content));
+  return _lowPriorityQueueBuffer[(_lowPriorityQueueHead + position) % (_maxContentLength + QUEUE_ITEM_HEADER_SIZE)];
 }
 
-bool BondedHM10::writeEvent(uint16_t id, const char *content, const uint16_t length)
+void BondedHM10::writeLowPriorityQueueByte(const uint16_t position, const uint8_t value)
 {
-  return writeEvent(id, (const uint8_t *)content, length);
+  _lowPriorityQueueBuffer[(_lowPriorityQueueHead + position) % (_maxContentLength + QUEUE_ITEM_HEADER_SIZE)] = value;
 }
 
-bool BondedHM10::writeEvent(uint16_t id, const __FlashStringHelper *content)
+unsigned long BondedHM10::getLowPriorityQueueItemTimestamp()
 {
-  bool success = true;
+  unsigned long timestamp = 0;
 
-  if (_initialized && _connected)
+  for (uint8_t i = 0; i < 4; i++)
   {
-    uint16_t length = getFlashStringHelperLength(content);
+    timestamp |= ((unsigned long)readLowPriorityQueueByte(5 + i) << (8 * i));
+  }
 
-    if (length > MAX_CONTENT_BUFFER_SIZE)
-    {
-#ifdef DEBUG
-      Serial.print(F("The length of event content provided ("));
-      Serial.print(length);
-      Serial.print(F(" bytes) surpasses the max length of "));
-      Serial.print(MAX_CONTENT_BUFFER_SIZE);
-      Serial.println(F(" bytes allowed for events."));
-#endif
+  return timestamp;
+}
 
-      success = false;
-    }
-    else
-    {
-      if (_dataTransmittedOutputPin >= 0)
-      {
-        startTransmissionTimer();
-      }
+uint16_t BondedHM10::sendLowPriorityQueueFragment()
+{
+  if (!_connected || _lowPriorityQueueUsed == 0)
+  {
+    return 0;
+  }
 
-      _stream->write(EVENT_PREFIX, PREFIX_LEN);
-      _stream->write(lowByte(id));
-      _stream->write(highByte(id));
-      _stream->write(lowByte(length));
-      _stream->write(highByte(length));
-      writeFlashStringHelperContent(content);
-    }
+  const bool isEvent = (readLowPriorityQueueByte(0) == 1);
+  const uint16_t id = (uint16_t)word(readLowPriorityQueueByte(2), readLowPriorityQueueByte(1));
+  const uint16_t length = (uint16_t)word(readLowPriorityQueueByte(4), readLowPriorityQueueByte(3));
+  const uint16_t remaining = length - _lowPriorityQueueSentOffset;
+  const uint16_t fragmentLength = min(remaining, FRAGMENT_SIZE);
+  uint16_t lengthField = fragmentLength;
+
+  if (fragmentLength < remaining)
+  {
+    lengthField |= FRAGMENT_MORE_FLAG;
   }
-  else
+
+  if (_lowPriorityQueueSentOffset > 0)
   {
-    success = false;
+    lengthField |= FRAGMENT_CONTINUATION_FLAG;
   }
 
-  return success;
-}
+  if (_dataTransmittedOutputPin >= 0)
+  {
+    startTransmissionTimer();
+  }
 
-void BondedHM10::setEventReceivedHandler(EventReceivedUInt8Delegate eventReceivedHandler)
-{
-  _eventReceivedUInt8Handler = eventReceivedHandler;
-}
+  writeFrameHeader(isEvent, id, lengthField, getLowPriorityQueueItemTimestamp());
 
-void BondedHM10::setEventReceivedHandler(EventReceivedCharDelegate eventReceivedHandler)
-{
-  _eventReceivedCharHandler = eventReceivedHandler;
-}
+  uint16_t position = QUEUE_ITEM_HEADER_SIZE + _lowPriorityQueueSentOffset;
 
-bool BondedHM10::writeMessage(const uint8_t *content, const uint16_t length)
-{
-  bool success = true;
+  for (uint16_t i = 0; i < fragmentLength; i++)
+  {
+    _stream->write(readLowPriorityQueueByte(position++));
+  }
 
-  if (_initialized && _connected)
+  _lowPriorityQueueSentOffset += fragmentLength;
+
+  if (fragmentLength == remaining)
   {
-    if (length > MAX_CONTENT_BUFFER_SIZE)
-    {
-#ifdef DEBUG
-      Serial.print(F("The length of message content provided ("));
-      Serial.print(length);
-      Serial.print(F(" bytes) surpasses the max length of "));
-      Serial.print(MAX_CONTENT_BUFFER_SIZE);
-      Serial.println(F(" bytes allowed for messages."));
-#endif
+    updateSendLatencyMetrics(Priority::Low, millis() - getLowPriorityQueueItemTimestamp());
+    _lowPriorityQueueHead = (_lowPriorityQueueHead + QUEUE_ITEM_HEADER_SIZE + length) % (_maxContentLength + QUEUE_ITEM_HEADER_SIZE);
+    _lowPriorityQueueUsed -= (QUEUE_ITEM_HEADER_SIZE + length);
+    _lowPriorityQueueSentOffset = 0;
 
-      success = false;
-    }
-    else
+    if (_lowPriorityQueueUsed == 0)
     {
-      if (_dataTransmittedOutputPin >= 0)
-      {
-        startTransmissionTimer();
-      }
-
-      _stream->write(MESSAGE_PREFIX, PREFIX_LEN);
-      _stream->write(lowByte(length));
-      _stream->write(highByte(length));
-      _stream->write(content, length);
+      _lowPriorityQueueHead = 0;
     }
   }
+
+  return fragmentLength;
+}
+
+uint16_t BondedHM10::sendQueuedFragment()
+{
+  // The receiver only reassembles one fragmented frame at a time, so a frame that has been started is always
+  // finished before the next one. Otherwise whichever queue holds the oldest frame goes next, which keeps the frames
+  // in the order they were written across a disconnect.
+  bool offlineQueueFirst;
+
+  if (_offlineQueueSentOffset > 0 || _lowPriorityQueueUsed == 0)
+  {
+    offlineQueueFirst = true;
+  }
+  else if (_lowPriorityQueueSentOffset > 0 || _offlineQueueItemCount == 0)
+  {
+    offlineQueueFirst = false;
+  }
   else
   {
-    success = false;
+    unsigned long now = millis();
+
+    offlineQueueFirst = ((now - getOfflineQueueItemTimestamp()) >= (now - getLowPriorityQueueItemTimestamp()));
   }
 
-  return success;
+  return (offlineQueueFirst ? sendOfflineQueueFragment() : sendLowPriorityQueueFragment());
 }
 
-bool BondedHM10::writeMessage(const char *content)
+void BondedHM10::drainTransmitQueues()
 {
-  return writeMessage(content, strlen(content));
-}
+  // Queued frames are sent a few fragments per pass, so a large backlog (such as the one built up while
+  // disconnected) doesn't hold up loop() until all of it has been written to the stream.
+  uint16_t budget = QUEUED_BYTES_PER_PASS;
 
-bool BondedHM10::writeMessage(const char *content, const uint16_t length)
-{
-  return writeMessage((const uint8_t *)content, length);
+  while (budget > 0)
+  {
+    uint16_t sent = sendQueuedFragment();
+
+    if (sent == 0)
+    {
+      break;
+    }
+
+    budget -= min(sent, budget);
+  }
 }
 
-bool BondedHM10::writeMessage(const __FlashStringHelper *content)
+bool BondedHM10::beginMessage()
 {
-  bool success = true;
-
-  if (_initialized && _connected)
+  if (!_initialized || !_connected || _printingMessage)
   {
-    uint16_t length = getFlashStringHelperLength(content);
+    return false;
+  }
 
-    if (length > MAX_CONTENT_BUFFER_SIZE)
-    {
-#ifdef DEBUG
-      Serial.print(F("The length of message content provided ("));
-      Serial.print(length);
-      Serial.print(F(" bytes) surpasses the max length of "));
-      Serial.print(MAX_CONTENT_BUFFER_SIZE);
-      Serial.println(F(" bytes allowed for messages."));
-#endif
+  if (_printBuffer == NULL)
+  {
+    // Only allocated the first time a message is printed, so sketches that never use print() don't pay for it.
+    _printBuffer = (uint8_t *)allocate(_printBufferSize, sizeof(uint8_t));
 
-      success = false;
-    }
-    else
+    if (_printBuffer == NULL)
     {
-      if (_dataTransmittedOutputPin >= 0)
-      {
-        startTransmissionTimer();
-      }
-
-      _stream->write(MESSAGE_PREFIX, PREFIX_LEN);
-      _stream->write(lowByte(length));
-      _stream->write(highByte(length));
-      writeFlashStringHelperContent(content);
+      return false;
     }
   }
-  else
+
+  _printingMessage = true;
+  _printFailed = false;
+  _printCursor = 0;
+
+  return true;
+}
+
+bool BondedHM10::endMessage()
+{
+  if (!_printingMessage)
   {
-    success = false;
+    return false;
   }
 
+  bool success = flushPrintBuffer() && !_printFailed;
+
+  _printingMessage = false;
+  _printFailed = false;
+
   return success;
 }
 
-void BondedHM10::setMessageReceivedHandler(MessageReceivedUInt8Delegate messageReceivedHandler)
+bool BondedHM10::flushPrintBuffer()
 {
-  _messageReceivedUInt8Handler = messageReceivedHandler;
-}
+  if (_printCursor == 0)
+  {
+    return true;
+  }
 
-void BondedHM10::setMessageReceivedHandler(MessageReceivedCharDelegate messageReceivedHandler)
-{
-  _messageReceivedCharHandler = messageReceivedHandler;
+  bool success = writeMessage(_printBuffer, _printCursor);
+  _printCursor = 0;
+
+  if (!success)
+  {
+    _printFailed = true;
+  }
+
+  return success;
 }
 
 size_t BondedHM10::write(uint8_t d)
 {
-  if (_dataTransmittedOutputPin >= 0)
+  if (_printingMessage)
   {
-    startTransmissionTimer();
+    // Output from print() is collected into message sized chunks. Each chunk is sent as its own framed
+    // message as soon as it fills up, and whatever remains is sent by endMessage.
+    _printBuffer[_printCursor++] = d;
+
+    if (_printCursor == _printBufferSize && !flushPrintBuffer())
+    {
+      return 0;
+    }
+
+    return 1;
   }
 
-  return _stream->write(d);
+  // Outside of beginMessage()/endMessage() the bytes would reach the remote unframed (or, while disconnected, the
+  // HM-10 as AT input), so they are dropped.
+  return 0;
 }
 
 size_t BondedHM10::write(const uint8_t *buffer, size_t size)
 {
-  if (_dataTransmittedOutputPin >= 0)
+  if (_printingMessage)
   {
-    startTransmissionTimer();
+    size_t written = 0;
+
+    while (written < size)
+    {
+      uint16_t chunkLen = min((size_t)(_printBufferSize - _printCursor), size - written);
+
+      memcpy(_printBuffer + _printCursor, buffer + written, chunkLen);
+      _printCursor += chunkLen;
+      written += chunkLen;
+
+      if (_printCursor == _printBufferSize && !flushPrintBuffer())
+      {
+        break;
+      }
+    }
+
+    return written;
   }
 
-  return _stream->write(buffer, size);
+  return 0;
 }
 
 int BondedHM10::availableForWrite()
 {
+  if (_printingMessage)
+  {
+    return _printBufferSize - _printCursor;
+  }
+
   return _stream->availableForWrite();
 }
 
 void BondedHM10::sendCommand_Internal(const char *command, const bool query, const char *param)
 {
-  const uint8_t commandLen = strlen(command);
-
-  if (commandLen == 0)
+  // The parts of the command are written straight to the stream, rather than put together in a buffer first.
+  if (command == NULL)
   {
-    // If command is an empty string, then the blank default "AT" command will be sent.
-    _stream->write(COMMAND_AT, 2);
+    // Without a command, the blank default "AT" command will be sent.
+    _stream->print((const __FlashStringHelper *)COMMAND_AT);
   }
   else
   {
-    const uint8_t paramLen = strlen(param);
+    _stream->print((const __FlashStringHelper *)COMMAND_PREFIX);
+    _stream->print((const __FlashStringHelper *)command);
 
-    memcpy(_commandStr, COMMAND_PREFIX, 3);
-    memcpy(_commandStr + 3, command, commandLen);
-
-    if (paramLen > 0)
+    if (param != NULL)
     {
-      memcpy(_commandStr + 3 + commandLen, param, paramLen);
+      _stream->print(param);
     }
 
     if (query)
     {
-      memcpy(_commandStr + 3 + commandLen + paramLen, QUERY, 1);
+      _stream->write('?');
     }
-
-    _stream->write(_commandStr, 3 + commandLen + paramLen + (query ? 1 : 0));
   }
 
   _stream->flush();
@@ -2172,13 +5327,13 @@ bool BondedHM10::sendCommandWithExpectedResponse(const char *command, const bool
 #ifdef VERBOSE
   Serial.print(F("Sending Command: "));
   Serial.print(F("command = "));
-  Serial.print(command);
+  Serial.print((command != NULL ? (const __FlashStringHelper *)command : F("")));
   Serial.print(F(", query = "));
   Serial.print((query ? F("true") : F("false")));
   Serial.print(F(", param = "));
   Serial.print(param);
   Serial.print(F(", expectedResponse = "));
-  Serial.print(expectedResponse);
+  Serial.print((expectedResponse != NULL ? (const __FlashStringHelper *)expectedResponse : F("")));
   Serial.print(F(", timeout = "));
   Serial.println(timeout);
   Serial.flush();
@@ -2203,7 +5358,7 @@ bool BondedHM10::waitForResponse_Internal(const char *expectedResponse, char *ac
 
   if (expectedResponse != NULL)
   {
-    expectedResponseLen = strlen(expectedResponse);
+    expectedResponseLen = strlen_P(expectedResponse);
   }
 
   while ((availableLen = _stream->available()) < expectedResponseLen)
@@ -2249,25 +5404,16 @@ bool BondedHM10::waitForResponse_Internal(const char *expectedResponse, char *ac
     }
   }
 
+  // A response to a connect command starts the same way as an OK+CONN notification, so it is left as it is.
+  bool connectResponseExpected = (expectedResponse == CONNECT_RESPONSE || expectedResponse == CONNECT_FAILURE_RESPONSE);
+
   while (availableLen > 0)
   {
     for (uint8_t i = 0; i < availableLen; i++)
     {
       responseChar = (char)_stream->read();
-      actualResponse[responseLen] = responseChar;
-
-      if (expectedResponseLen > 0 && responseLen < expectedResponseLen && responseChar != expectedResponse[responseLen])
-      {
-#ifdef DEBUG
-#ifdef VERBOSE
-        Serial.println(F("Unexpected character read."));
-#endif
-#endif
-
-        success = false;
-      }
-
-      responseLen++;
+      actualResponse[responseLen++] = responseChar;
+      responseLen = removeNotification(actualResponse, responseLen, connectResponseExpected);
     }
 
     currentTime = millis();
@@ -2282,6 +5428,17 @@ bool BondedHM10::waitForResponse_Internal(const char *expectedResponse, char *ac
 
   clearString(actualResponse, responseLen);
 
+  if (expectedResponseLen > 0 && strncmp_P(actualResponse, expectedResponse, expectedResponseLen) != 0)
+  {
+#ifdef DEBUG
+#ifdef VERBOSE
+    Serial.println(F("Unexpected response read."));
+#endif
+#endif
+
+    success = false;
+  }
+
   if (!success || responseLen < expectedResponseLen)
   {
     return false;
@@ -2292,13 +5449,49 @@ bool BondedHM10::waitForResponse_Internal(const char *expectedResponse, char *ac
   }
 }
 
+uint16_t BondedHM10::removeNotification(char *response, const uint16_t length, const bool connectResponseExpected)
+{
+  // The module sends OK+CONN/OK+LOST whenever the connection changes, which can be in the middle of an AT response.
+  // A notification at the end of what has been read so far is taken out of the response and handed to the
+  // notification parser instead. Both notifications are the same length.
+  const uint8_t notificationLength = strlen_P(AT_LOST_RESPONSE);
+  const char *notification = NULL;
+
+  if (length < notificationLength)
+  {
+    return length;
+  }
+
+  if (strncmp_P(response + length - notificationLength, AT_LOST_RESPONSE, notificationLength) == 0)
+  {
+    notification = AT_LOST_RESPONSE;
+  }
+  else if (!connectResponseExpected && strncmp_P(response + length - notificationLength, CONNECT_RESPONSE, notificationLength) == 0)
+  {
+    notification = CONNECT_RESPONSE;
+  }
+  else
+  {
+    return length;
+  }
+
+  _notificationCursor = 0;
+
+  for (uint8_t i = 0; i < notificationLength; i++)
+  {
+    processNotificationByte(pgm_read_byte(&notification[i]));
+  }
+
+  return length - notificationLength;
+}
+
 bool BondedHM10::waitForResponse(const char *expectedResponse, char *actualResponse, const uint16_t timeout)
 {
 #ifdef DEBUG
 #ifdef VERBOSE
   Serial.print(F("Waiting for Response: "));
   Serial.print(F("expectedResponse = "));
-  Serial.print(expectedResponse);
+  Serial.print((expectedResponse != NULL ? (const __FlashStringHelper *)expectedResponse : F("")));
   Serial.print(F(", timeout = "));
   Serial.println(timeout);
   Serial.flush();
@@ -2310,34 +5503,6 @@ bool BondedHM10::waitForResponse(const char *expectedResponse, char *actualRespo
   return waitForResponse_Internal(expectedResponse, actualResponse, timeout, startTime);
 }
 
-void BondedHM10::parseCommandResponseValue(const char *responsePrefix, const char *response, char *value)
-{
-  uint8_t responseLen = strlen(response);
-
-  if (responseLen == 0)
-  {
-    clearString(value);
-  }
-  else
-  {
-    uint16_t valueIndex = 0;
-    uint8_t prefixLen = 0;
-
-    if (responsePrefix != NULL)
-    {
-      prefixLen = strlen(responsePrefix);
-    }
-
-    for (uint8_t i = prefixLen; i < responseLen; i++)
-    {
-      value[valueIndex] = response[i];
-      valueIndex++;
-    }
-
-    clearString(value, valueIndex);
-  }
-}
-
 void BondedHM10::clearString(char *str, const uint16_t startIndex)
 {
   uint8_t strLen = strlen(str);
@@ -2367,6 +5532,27 @@ void BondedHM10::onConnect()
     digitalWrite(_connectedOutputPin, HIGH);
   }
 
+  _lastReceiveTime = millis();
+  _heartbeatMisses = 0;
+  _reconnectDelay = _reconnectInitialDelay;
+  _reconnectJitter = 0;
+
+  // The whitelist (Peripheral) and the connect command (Central) only ever let the module connect to the remote
+  // address, so that is what the module now has as its last connected address.
+  strncpy(_lastConnectedAddressStr, _remoteAddress, 12);
+  _lastConnectedAddressCached = true;
+
+  // Each side only ever sends on a channel as much as the other side has granted it. Grants don't carry over
+  // between connections, so the full receive window of each open channel is granted again.
+  for (uint8_t channel = 0; _channels != NULL && channel < MAX_CHANNELS; channel++)
+  {
+    if (_channels[channel].open)
+    {
+      _channels[channel].consumed = 0;
+      sendChannelCredits(channel, _channels[channel].receiveWindow);
+    }
+  }
+
   if (_connectedHandler)
   {
     _connectedHandler(isReconnected);
@@ -2379,6 +5565,39 @@ void BondedHM10::onDisconnect()
   _connecting = false; // Done here as a safety precaution.
   _disconnected = true;
 
+  // Anything that was part way through being received or sent is incomplete now, and a low priority frame
+  // that was part way through being sent will be sent again from the start.
+  resetPrefixDetection();
+  resetEventParsing();
+  abandonFragmentAssembly();
+  _offlineQueueSentOffset = 0;
+  _lowPriorityQueueSentOffset = 0;
+
+  for (uint8_t channel = 0; _channels != NULL && channel < MAX_CHANNELS; channel++)
+  {
+    _channels[channel].credits = 0;
+  }
+
+  // Responses to calls made over the lost connection will never arrive.
+  failPendingRpcCalls(RpcStatus::Disconnected);
+
+  // The remote may well restart before the next connection, so its clock has to be synchronized again.
+  if (_clock != NULL)
+  {
+    _clock->synchronized = false;
+    _clock->offset = 0;
+    _clock->drift = 0;
+  }
+
+  // A blob transfer that was under way is resumed (from wherever the receiver got to) once reconnected.
+  if (_blob != NULL)
+  {
+    _blob->started = false;
+    _blob->endSent = false;
+    _blob->timeoutCount = 0;
+    _blob->lastAckTime = millis() - BLOB_ACK_TIMEOUT;
+  }
+
   if (_connectedOutputPin > -1)
   {
     digitalWrite(_connectedOutputPin, LOW);
@@ -2400,6 +5619,7 @@ void BondedHM10::detectAndHandleConnection()
       Serial.println(F("Connect detected."));
 #endif
 
+      _connectionStateChangeTimestamp = getStatePinChangeTimestamp();
       onConnect();
     }
   }
@@ -2411,9 +5631,10 @@ void BondedHM10::detectAndHandleConnection()
       Serial.println(F("Disconnect detected."));
 #endif
 
+      _connectionStateChangeTimestamp = getStatePinChangeTimestamp();
       onDisconnect();
     }
-    else if ((_role == Role::Central) && _autoReconnectEnabled && ((millis() - _lastConnectAttemptTimestamp) >= _autoReconnectTimeout) && !_manuallyDisconnected)
+    else if ((_role == Role::Central) && _autoReconnectEnabled && ((millis() - _lastConnectAttemptTimestamp) >= getJitteredReconnectDelay()) && !_manuallyDisconnected)
     {
       // If Auto-Reconnect is enabled AND we've waited the configured amount of time since the last connection attempt
       // AND the bluetooth device had not been manually disconnected, THEN attempt to reconnect to the last connected device.
@@ -2423,24 +5644,27 @@ void BondedHM10::detectAndHandleConnection()
 #endif
 
       bool timestampBeforeConnect = false;
+      unsigned long attemptStartTime = millis();
 
-      if (_autoReconnectTimeout > (CONNECTING_COMMAND_TIMEOUT + CONNECT_COMMAND_TIMEOUT))
+      if (getReconnectDelay() > (unsigned long)(CONNECTING_COMMAND_TIMEOUT + CONNECT_COMMAND_TIMEOUT))
       {
         timestampBeforeConnect = true;
         _lastConnectAttemptTimestamp = millis();
       }
 
       // Only attempt to reconnect if the last connected address matches the peripheral address.
-      if (getLastConnectedAddress(_lastConnectedAddressStr))
+      if (getCachedLastConnectedAddress())
       {
         startWork();
 
-        if (strcmp(_lastConnectedAddressStr, _remoteAddress) != 0 || strcmp(_lastConnectedAddressStr, EMPTY_ADDRESS) == 0)
+        if (strcmp(_lastConnectedAddressStr, _remoteAddress) != 0 || strcmp_P(_lastConnectedAddressStr, EMPTY_ADDRESS) == 0)
         {
           connectToPeripheral();
         }
       }
 
+      recordReconnectAttempt(isConnected(), millis() - attemptStartTime);
+
       if (!timestampBeforeConnect)
       {
         _lastConnectAttemptTimestamp = millis();
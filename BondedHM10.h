@@ -23,6 +23,24 @@ class BondedHM10: public Print
 public:
 
     static const uint16_t DEFAULT_MAX_BYTES_TO_READ = 256;
+    static const uint8_t MAX_RECEIVE_BUFFER_COUNT = 8;
+    static const uint8_t DEFAULT_RECEIVE_BUFFER_COUNT = 4;
+    static const uint16_t DEFAULT_MAX_CONTENT_LENGTH = 256;
+    static const uint16_t DEFAULT_PRINT_BUFFER_SIZE = 64;
+    static const uint16_t DEFAULT_OFFLINE_QUEUE_SIZE = 128;
+    static const uint16_t DEFAULT_CHANNEL_QUEUE_SIZE = 64;
+    static const unsigned long DEFAULT_DISPATCH_BUDGET = 5000; // microseconds
+    static const unsigned long DEFAULT_SLOW_HANDLER_THRESHOLD = 10000; // microseconds
+    static const uint16_t RESERVED_EVENT_ID_BASE = 0xFF00; // Event IDs from here on up are used by the library itself.
+    static const uint8_t MAX_CHANNELS = 4;
+    static const uint8_t MAX_RPC_METHODS = 8;
+    static const uint8_t MAX_PENDING_RPC_CALLS = 4;
+    static const unsigned long DEFAULT_RPC_TIMEOUT = 1000; // milliseconds
+    static const uint8_t ROUND_TRIP_BUCKET_COUNT = 16;
+    static const uint8_t DEFAULT_HEARTBEAT_MISS_LIMIT = 3;
+    static const uint8_t DEFAULT_RECONNECT_JITTER = 20; // percent
+    static const uint8_t PROVISION_FINGERPRINT_SIZE = 10; // bytes of EEPROM used by the provisioning fingerprint.
+    static const uint8_t CONFIG_BLOB_SIZE = 38; // bytes used by saveConfig()/restoreConfig().
 
     enum Role
     {
@@ -71,14 +89,112 @@ public:
     };
 
 
+    enum NotificationsMode
+    {
+        KeepNotifications = 0,
+        EnableNotifications = 1,
+        DisableNotifications = 2
+    };
+
+
+    enum DeviceConfigField
+    {
+        ConfigName = 0x0001,
+        ConfigFirmwareVersion = 0x0002,
+        ConfigAddress = 0x0004,
+        ConfigRole = 0x0008,
+        ConfigBaudRate = 0x0010,
+        ConfigWorkType = 0x0020,
+        ConfigBondMode = 0x0040,
+        ConfigWhitelistEnabled = 0x0080,
+        ConfigWhitelistSlot1 = 0x0100,
+        ConfigWhitelistSlot2 = 0x0200,
+        ConfigWhitelistSlot3 = 0x0400,
+        ConfigOutputStatePins = 0x0800,
+        ConfigNotificationsEnabled = 0x1000
+    };
+
+
+    struct DeviceConfig
+    {
+        char name[13];
+        char firmwareVersion[32];
+        char address[13];
+        Role role;
+        BaudRate baudRate;
+        WorkType workType;
+        BondMode bondMode;
+        bool whitelistEnabled;
+        char whitelistAddresses[3][13];
+        char outputStatePins[4];
+        bool notificationsEnabled;
+    };
+
+
+    enum Priority
+    {
+        Low = 0,
+        High = 1
+    };
+
+
+    enum OfflineQueuePolicy
+    {
+        DropOldest = 0,
+        DropNewest = 1
+    };
+
+
+    struct SendLatencyMetrics
+    {
+        uint32_t frames;
+        uint32_t totalMillis;
+        uint32_t maxMillis;
+    };
+
+
+    struct HandlerMetrics
+    {
+        uint32_t invocations;
+        uint32_t totalMicros;
+        uint32_t maxMicros;
+        uint32_t slowInvocations;
+    };
+
+
     BondedHM10(const Role role, const char* remoteAddress, const byte statePin, const byte resetPin);
 
-    bool provision(const BaudRate baudRate);
+    bool provision(const BaudRate baudRate, const NotificationsMode notificationsMode = KeepNotifications);
+    uint16_t getProvisionedSettings();
+    bool getProvisionSkipped();
+
+    void setProvisionFingerprintEnabled(const bool enabled, const uint16_t eepromAddress = 0);
+    bool getProvisionFingerprintEnabled();
+    void clearProvisionFingerprint();
+
+    bool saveConfig(uint8_t* blob);
+    bool restoreConfig(const uint8_t* blob);
 
     bool begin(Stream& stream, bool autoConnect = true);
     bool ready();
     void loop(uint16_t maxBytesToRead = DEFAULT_MAX_BYTES_TO_READ);
 
+    bool setReceiveBufferCount(const uint8_t count);
+    uint8_t getReceiveBufferCount();
+
+    bool setDeferredDispatchEnabled(const bool enabled);
+    bool getDeferredDispatchEnabled();
+    uint8_t dispatch(const unsigned long budget = DEFAULT_DISPATCH_BUDGET);
+    uint8_t getPendingFrameCount();
+
+    unsigned long getSlowHandlerThreshold();
+    void setSlowHandlerThreshold(const unsigned long threshold);
+
+    uint16_t getAllocationCount();
+    void getMessageHandlerMetrics(HandlerMetrics& metrics);
+    void getEventHandlerMetrics(HandlerMetrics& metrics);
+    void resetHandlerMetrics();
+
     void setConsoleModeEnabled(const bool enabled);
     bool getConsoleModeEnabled();
 
@@ -106,6 +222,23 @@ public:
     long getAutoReconnectTimeout();
     void setAutoReconnectTimeout(const unsigned long timeout);
 
+    bool getWarmStartEnabled();
+    void setWarmStartEnabled(const bool enabled);
+
+    struct ReconnectStats
+    {
+        uint16_t attempts;
+        uint16_t failures;
+        unsigned long lastAttemptDuration;
+        unsigned long longestAttemptDuration;
+        unsigned long currentDelay;
+    };
+
+    void setReconnectBackoff(const unsigned long initialDelay, const unsigned long maxDelay, const uint8_t jitterPercent = DEFAULT_RECONNECT_JITTER);
+    unsigned long getReconnectDelay();
+    void getReconnectStats(ReconnectStats& stats);
+    void resetReconnectStats();
+
     bool isConnected(bool testForTransientConnection);
     bool isConnected();
 
@@ -125,8 +258,12 @@ public:
     bool getWorkType(WorkType& workType);
     bool getLastConnectedAddress(char* address);
     bool getWhitelistEnabled(bool& enabled);
+    bool getNotificationsEnabled(bool& enabled);
     bool getWhitelistAddress(const WhitelistSlot slot, char* address);
     bool getBondMode(BondMode& bondMode);
+    bool getConnectedOutputStatePins(char* pinHex);
+    bool getDeviceConfig(DeviceConfig& config);
+    void invalidateDeviceConfig();
 
 #ifdef DEBUG
     void printDeviceConfig();
@@ -137,6 +274,9 @@ public:
     bool writeEvent(uint16_t id, const char* content);
     bool writeEvent(uint16_t id, const char* content, const uint16_t length);
     bool writeEvent(uint16_t id, const __FlashStringHelper* content);
+    bool writeEvent(uint16_t id, const uint8_t* content, const uint16_t length, const Priority priority);
+    bool writeEvent(uint16_t id, const char* content, const Priority priority);
+    bool writeEvent(uint16_t id, const __FlashStringHelper* content, const Priority priority);
 
     typedef void (*EventReceivedUInt8Delegate)(const uint16_t id, const uint8_t* content, const uint16_t length);
     void setEventReceivedHandler(EventReceivedUInt8Delegate eventReceivedHandler);
@@ -149,6 +289,12 @@ public:
     bool writeMessage(const char* content);
     bool writeMessage(const char* content, const uint16_t length);
     bool writeMessage(const __FlashStringHelper* content);
+    bool writeMessage(const uint8_t* content, const uint16_t length, const Priority priority);
+    bool writeMessage(const char* content, const Priority priority);
+    bool writeMessage(const __FlashStringHelper* content, const Priority priority);
+
+    void getSendLatencyMetrics(const Priority priority, SendLatencyMetrics& metrics);
+    void resetSendLatencyMetrics();
 
     typedef void (*MessageReceivedUInt8Delegate)(const uint8_t* content, const uint16_t length);
     void setMessageReceivedHandler(MessageReceivedUInt8Delegate messageReceivedHandler);
@@ -156,30 +302,266 @@ public:
     typedef void (*MessageReceivedCharDelegate)(const char* content, const uint16_t length);
     void setMessageReceivedHandler(MessageReceivedCharDelegate messageReceivedHandler);
 
+    bool setOfflineQueueEnabled(const bool enabled);
+    bool getOfflineQueueEnabled();
+    OfflineQueuePolicy getOfflineQueuePolicy();
+    void setOfflineQueuePolicy(const OfflineQueuePolicy policy);
+    bool setOfflineQueueEepromSpill(const uint16_t address, const uint16_t size);
+    uint16_t getOfflineQueueCount();
+    uint32_t getOfflineQueueDroppedCount();
+    void clearOfflineQueue();
+
+    bool beginMessage();
+    bool endMessage();
+
+    bool setStreamingReceiveEnabled(const bool enabled);
+    bool getStreamingReceiveEnabled();
+
+    typedef void (*FrameStartDelegate)(const bool isEvent, const uint16_t id, const uint16_t length);
+    void setFrameStartHandler(FrameStartDelegate frameStartHandler);
+
+    typedef void (*FrameChunkDelegate)(const uint8_t* content, const uint16_t length);
+    void setFrameChunkHandler(FrameChunkDelegate frameChunkHandler);
+
+    typedef void (*FrameEndDelegate)(void);
+    void setFrameEndHandler(FrameEndDelegate frameEndHandler);
+
+    bool retainContent(const uint8_t* content);
+    bool retainContent(const char* content);
+    void releaseContent(const uint8_t* content);
+    void releaseContent(const char* content);
+    uint32_t getDroppedFrameCount();
+
+    bool openChannel(const uint8_t channel, const uint8_t receiveWindow);
+    void closeChannel(const uint8_t channel);
+    bool writeChannel(const uint8_t channel, const uint8_t* content, const uint16_t length);
+    bool writeChannel(const uint8_t channel, const char* content);
+    uint8_t getChannelQueueCount(const uint8_t channel);
+    uint8_t getChannelCredits(const uint8_t channel);
+
+    typedef void (*ChannelReceivedDelegate)(const uint8_t channel, const uint8_t* content, const uint16_t length);
+    void setChannelReceivedHandler(ChannelReceivedDelegate channelReceivedHandler);
+
+    enum RpcStatus
+    {
+        Ok = 0,
+        MethodNotFound = 1,
+        TimedOut = 2,
+        Disconnected = 3
+    };
+
+    typedef void (*RpcMethodDelegate)(const uint8_t method, const uint8_t callID, const uint8_t* content, const uint16_t length);
+    typedef void (*RpcCompletedDelegate)(const uint8_t callID, const RpcStatus status, const uint8_t* content, const uint16_t length);
+    bool registerRpcMethod(const uint8_t method, RpcMethodDelegate methodHandler);
+    uint8_t callRpc(const uint8_t method, const uint8_t* content, const uint16_t length, RpcCompletedDelegate completedHandler, const unsigned long timeout = DEFAULT_RPC_TIMEOUT);
+    uint8_t callRpc(const uint8_t method, const char* content, RpcCompletedDelegate completedHandler, const unsigned long timeout = DEFAULT_RPC_TIMEOUT);
+    bool replyRpc(const uint8_t callID, const uint8_t* content, const uint16_t length);
+    bool replyRpc(const uint8_t callID, const char* content);
+    uint8_t getPendingRpcCount();
+
+    typedef uint16_t (*BlobReadDelegate)(const uint32_t offset, uint8_t* content, const uint16_t length);
+    typedef bool (*BlobWriteDelegate)(const uint32_t offset, const uint8_t* content, const uint16_t length);
+    typedef void (*BlobProgressDelegate)(const bool sending, const uint32_t transferred, const uint32_t size);
+    enum BlobStatus
+    {
+        BlobSucceeded = 0,
+        BlobFailed = 1,     // the content couldn't be read, or didn't arrive intact.
+        BlobTimedOut = 2    // the receiver stopped answering.
+    };
+
+    typedef void (*BlobCompletedDelegate)(const bool sending, const BlobStatus status);
+    bool sendBlob(const uint32_t size, BlobReadDelegate blobReadHandler);
+    bool isSendingBlob();
+    void cancelBlob();
+    void setBlobWriteHandler(BlobWriteDelegate blobWriteHandler);
+    void setBlobProgressHandler(BlobProgressDelegate blobProgressHandler);
+    void setBlobCompletedHandler(BlobCompletedDelegate blobCompletedHandler);
+
+    bool ping();
+    void setPingInterval(const unsigned long interval);
+    unsigned long getPingInterval();
+    uint16_t getRoundTripPercentile(const uint8_t percentile);
+    uint16_t getRoundTripMax();
+    uint16_t getRoundTripSampleCount();
+    void resetRoundTripHistogram();
+
+    typedef void (*PingDelegate)(const unsigned long roundTripMicros);
+    void setPingHandler(PingDelegate pingHandler);
+
+    bool syncClock();
+    void setClockSyncInterval(const unsigned long interval);
+    unsigned long getClockSyncInterval();
+    bool isClockSynchronized();
+    long getClockOffset();
+    long getClockDrift();
+    unsigned long remoteMillis();
+    unsigned long remoteMillis(const unsigned long localTime);
+    unsigned long localMillis(const unsigned long remoteTime);
+    void setFrameTimestampsEnabled(const bool enabled);
+    bool isFrameTimestampsEnabled();
+    unsigned long getFrameTimestamp();
+    long getFrameLatency();
+
+    void setHeartbeat(const unsigned long interval, const uint8_t missLimit = DEFAULT_HEARTBEAT_MISS_LIMIT);
+    unsigned long getHeartbeatInterval();
+    uint16_t getHeartbeatTimeoutCount();
+
+    bool setStatePinInterruptEnabled(const bool enabled);
+    bool isStatePinInterruptEnabled();
+    unsigned long getConnectionStateChangeTimestamp();
+
     virtual size_t write(uint8_t);
     virtual size_t write(const uint8_t* buffer, size_t size);
     virtual int availableForWrite();
 
     static void handleTransmissionTimerInterrupt();
+    static void handleStatePinInterrupt();
+
+
+protected:
+    static const uint16_t MAX_BYTES_READ_PER_LOOP = 25;
+    static const uint8_t QUEUE_ITEM_HEADER_SIZE = 9; // frame type + 2 bytes for the ID + 2 bytes for the length + 4 byte timestamp.
+
+    struct ReceivedFrame
+    {
+        uint8_t bufferIndex;
+        bool isEvent;
+        uint16_t id;
+        uint16_t length;
+        unsigned long timestamp;
+    };
+
+    struct Channel
+    {
+        uint8_t* queue;
+        uint16_t queueHead;
+        uint16_t queueUsed;
+        uint8_t queuedFrames;
+        uint8_t credits;
+        uint8_t receiveWindow;
+        uint8_t consumed;
+        bool open;
+    };
+
+    struct RpcMethod
+    {
+        uint8_t method;
+        RpcMethodDelegate handler;
+    };
+
+    struct PendingRpcCall
+    {
+        uint8_t callID;
+        RpcCompletedDelegate completedHandler;
+        unsigned long startTime;
+        unsigned long timeout;
+    };
+
+
+    // The state of the optional features. Each block is only allocated when its feature is first used, so sketches
+    // that leave a feature alone don't pay for it. BondedHM10T hands over blocks of its own instead.
+    struct RpcState
+    {
+        RpcMethod methods[MAX_RPC_METHODS];
+        PendingRpcCall pendingCalls[MAX_PENDING_RPC_CALLS];
+        uint8_t lastCallID;
+    };
+
+    struct BlobState
+    {
+        bool sending;
+        bool started;
+        bool endSent;
+        bool transferIDSeeded;
+        uint8_t transferID;
+        uint32_t size;
+        uint32_t ackedOffset;
+        uint32_t nextOffset;
+        uint32_t checksumOffset;
+        uint16_t checksum;
+        unsigned long lastAckTime;
+        uint16_t chunkSize;
+        uint8_t timeoutCount;
+        BlobReadDelegate readHandler;
+        bool receiving;
+        bool receiveSucceeded;
+        uint8_t receiveID;
+        uint8_t chunksSinceAck;
+        uint32_t receiveSize;
+        uint32_t receivedOffset;
+        uint16_t receiveChecksum;
+    };
+
+    struct ClockState
+    {
+        unsigned long lastSyncTime;
+        unsigned long driftBaseTime;
+        long driftBaseOffset;
+        long offset;
+        long drift; // parts per million
+        bool synchronized;
+    };
+
+    struct RoundTripState
+    {
+        uint16_t buckets[ROUND_TRIP_BUCKET_COUNT];
+        uint16_t sampleCount;
+        uint16_t max;
+        uint16_t previousMax;
+    };
+
+    struct FeatureState
+    {
+        DeviceConfig deviceConfig;
+        RpcState rpc;
+        BlobState blob;
+        ClockState clock;
+        RoundTripState roundTrip;
+    };
+
+    BondedHM10(const Role role, const char* remoteAddress, const byte statePin, const byte resetPin, const uint16_t maxContentLength, const uint8_t receiveBufferCount, uint8_t* receiveBuffers, ReceivedFrame* receivedFrameQueue, uint8_t* printBuffer, const uint16_t printBufferSize, uint8_t* lowPriorityQueueBuffer, uint8_t* offlineQueueBuffer, const uint16_t offlineQueueSize, Channel* channels, uint8_t* channelQueues, const uint16_t channelQueueSize, FeatureState* featureState);
+
+    void serviceConnection();
+    void receiveBytes(const byte* bytes, const uint16_t count);
+    void serviceLink();
+    bool isReceivingFrames();
+    Stream* getStream();
 
 
 private:
 
     bool provision_Central();
     bool provision_Peripheral();
+    bool provisionRole(const Role role, const bool readFirst = true);
+    bool provisionWorkType(const WorkType workType, const bool readFirst = true);
+    bool provisionWhitelistEnabled(const bool enabled, const bool readFirst = true);
+    bool provisionWhitelistAddress(const WhitelistSlot slot, const char* address, const bool readFirst = true);
+    bool provisionBondMode(const BondMode bondMode, const bool readFirst = true);
+    bool provisionConnectedOutputStatePins(const char* pinHex, const bool readFirst = true);
+    bool provisionNotificationsEnabled(const bool enabled, const bool readFirst = true);
+    bool provisionDeviceName(const char* deviceName, const bool readFirst = true);
+    bool provisionBaudRate(const BaudRate baudRate, const bool readFirst = true);
+    bool getProvisionFingerprint(const BaudRate baudRate, const NotificationsMode notificationsMode, uint8_t* fingerprint);
+    bool isProvisionFingerprintStored(const uint8_t* fingerprint);
+    void storeProvisionFingerprint(const uint8_t* fingerprint);
+    static uint32_t updateFingerprintHash(uint32_t hash, const uint8_t value);
+    static bool packHex(const char* hex, uint8_t* packed, const uint8_t digitCount);
+    static void unpackHex(const uint8_t* packed, const uint8_t digitCount, char* hex);
 
     bool begin_Central(bool autoConnect);
+    bool adoptExistingConnection();
     bool begin_Peripheral(bool autoConnect);
 
+    // command and expectedResponse are PROGMEM strings, param is in RAM.
     void sendCommand_Internal(const char* command, const bool query, const char* param);
 
     bool sendCommandWithExpectedResponse(const char* command, const bool query, const char* param, const char* expectedResponse, char* actualResponse, const uint16_t timeout);
     bool sendCommandWithExpectedResponse(const char* command, const bool query, const char* param, const char* expectedResponse, char* actualResponse);
 
     bool waitForResponse_Internal(const char* expectedResponse, char* actualResponse, const uint16_t timeout, const unsigned long startTime);
+    uint16_t removeNotification(char* response, const uint16_t length, const bool connectResponseExpected);
     bool waitForResponse(const char* expectedResponse, char* actualResponse, const uint16_t timeout);
 
-    void parseCommandResponseValue(const char* responsePrefix, const char* response, char* value);
 
     void clearString(char* str, const uint16_t startIndex);
     void clearString(char* str);
@@ -193,6 +575,88 @@ private:
     uint16_t getFlashStringHelperLength(const __FlashStringHelper* content);
     void writeFlashStringHelperContent(const __FlashStringHelper* content);
 
+    bool flushPrintBuffer();
+
+    bool writeFrame(const bool isEvent, const uint16_t id, const uint8_t* content, const uint16_t length, const bool contentInFlash, const Priority priority);
+    void updateSendLatencyMetrics(const Priority priority, const unsigned long latency);
+    void writeFrameHeader(const bool isEvent, const uint16_t id, const uint16_t length);
+    void writeFrameHeader(const bool isEvent, const uint16_t id, uint16_t length, const unsigned long timestamp);
+
+    bool isUserEventID(const uint16_t id);
+    bool isControlEvent(const uint16_t id);
+    bool writeControlEvent(const uint16_t id, const uint8_t* header, const uint8_t headerLength, const uint8_t* content, const uint16_t length);
+    void dispatchReservedEvent(const uint16_t id, uint8_t* content, const uint16_t length);
+    void handleControlEvent(const uint16_t id, const uint8_t* content, const uint16_t length);
+
+    void serviceChannels();
+    void dispatchChannelFrame(const uint8_t channel, uint8_t* content, const uint16_t length);
+    void returnChannelCredit(const uint8_t channel);
+    bool sendChannelCredits(const uint8_t channel, const uint8_t credits);
+    void receiveChannelCredits(const uint8_t channel, const uint8_t credits);
+
+    PendingRpcCall* findPendingRpcCall(const uint8_t callID);
+    void completeRpcCall(PendingRpcCall* call, const RpcStatus status, const uint8_t* content, const uint16_t length);
+    void checkRpcTimeouts();
+    void failPendingRpcCalls(const RpcStatus status);
+    void dispatchRpcRequest(uint8_t* content, const uint16_t length);
+    void dispatchRpcResponse(uint8_t* content, const uint16_t length);
+
+    void serviceBlobTransfer();
+    void dispatchBlobEvent(const uint16_t id, uint8_t* content, const uint16_t length);
+    void failBlobTransfer(const BlobStatus status);
+    void sendBlobAck();
+    void recordRoundTrip(const unsigned long roundTripMicros);
+    void checkHeartbeat();
+    void processNotificationByte(const byte currentByte);
+    void onConnectNotification();
+    bool readStatePin();
+    void recordReconnectAttempt(const bool connected, const unsigned long duration);
+    unsigned long getJitteredReconnectDelay();
+    unsigned long getStatePinChangeTimestamp();
+    void updateClockSync(const unsigned long requestTime, const unsigned long remoteReceiveTime, const unsigned long remoteSendTime, const unsigned long responseTime);
+
+    static uint16_t updateBlobChecksum(uint16_t crc, const uint8_t* content, const uint16_t length);
+    static void writeUInt32(uint8_t* destination, const uint32_t value);
+    static uint32_t readUInt32(const uint8_t* source);
+
+    uint16_t getOfflineQueueCapacity();
+    uint8_t readOfflineQueueByte(const uint16_t position);
+    void writeOfflineQueueByte(const uint16_t position, const uint8_t value);
+    uint16_t getOfflineQueueItemSize(const uint16_t position);
+    void dropOldestOfflineQueueItem();
+    bool queueOfflineFrame(const bool isEvent, const uint16_t id, const uint8_t* content, const uint16_t length, const bool contentInFlash);
+    unsigned long getOfflineQueueItemTimestamp();
+    uint16_t sendOfflineQueueFragment();
+    bool queueLowPriorityFrame(const bool isEvent, const uint16_t id, const uint8_t* content, const uint16_t length, const bool contentInFlash);
+    uint8_t readLowPriorityQueueByte(const uint16_t position);
+    void writeLowPriorityQueueByte(const uint16_t position, const uint8_t value);
+    unsigned long getLowPriorityQueueItemTimestamp();
+    uint16_t sendLowPriorityQueueFragment();
+    uint16_t sendQueuedFragment();
+    void drainTransmitQueues();
+
+    void processIncomingByte(const byte currentByte);
+    void processFrameByte(const byte currentByte);
+    void processFrameLength(const uint16_t lengthField);
+    void abandonFragmentAssembly();
+    void deliverFrameChunk();
+    void dropReceivedFrame(const bool isEvent, const uint16_t id);
+    void dispatchReceivedFrame(const bool isEvent, const uint16_t id, uint8_t* content, const uint16_t length);
+    void updateHandlerMetrics(HandlerMetrics& metrics, const unsigned long elapsed);
+    void queueReceivedFrame(const bool isEvent, const uint16_t id, const uint8_t bufferIndex, const uint16_t length);
+    void* allocate(const size_t count, const size_t size);
+    bool allocateContentBuffer(const bool streaming);
+    bool allocateDeviceConfig();
+    bool allocateChannels();
+    bool allocateRpcState();
+    bool allocateBlobState();
+    bool allocateClockState();
+    bool allocateRoundTripState();
+    bool hasSpareReceiveBuffer(const uint8_t heldIndex);
+    uint16_t getReceiveBufferSize(const uint8_t index);
+    bool selectReceiveBuffer(const uint16_t length);
+    int8_t getReceiveBufferIndex(const uint8_t* content);
+
     void resetPrefixDetection();
     void resetEventParsing();
     void resetContentParsing();
@@ -206,17 +670,55 @@ private:
     bool setBaudRate(const BaudRate baudRate);
     bool setWorkType(const WorkType workType);
     bool clearLastConnectedAddress();
+    bool getCachedLastConnectedAddress();
+    bool isDeviceConfigFieldValid(const uint16_t field);
+    static uint16_t whitelistField(const WhitelistSlot slot);
     bool setWhitelistEnabled(const bool enabled);
+    bool setNotificationsEnabled(const bool enabled);
     bool setWhitelistAddress(const WhitelistSlot slot, const char* address);
     bool setBondMode(const BondMode bondMode);
+    bool getSetting(const uint8_t setting, char* value);
+    bool setSetting(const uint8_t setting, const char* value);
+    bool getSetting(const uint8_t setting, uint8_t& value);
+    bool setSetting(const uint8_t setting, const uint8_t value);
+#ifdef DEBUG
+    void printSetting(const uint8_t setting, const bool set, const bool success, const char* value);
+#endif
 
 
     static BondedHM10* _instance;
 
-    char* _responseStr = NULL;
-    char* _commandStr = NULL;
-    char* _lastConnectedAddressStr = NULL;
+    char _responseStr[32] = {};
+    char _lastConnectedAddressStr[13] = {};
+    bool _staticStorage = false;
+    uint16_t _maxContentLength = DEFAULT_MAX_CONTENT_LENGTH;
+    uint16_t _printBufferSize = DEFAULT_PRINT_BUFFER_SIZE;
+    uint16_t _offlineQueueSize = DEFAULT_OFFLINE_QUEUE_SIZE;
+    uint16_t _channelQueueSize = DEFAULT_CHANNEL_QUEUE_SIZE;
+    bool _lastConnectedAddressCached = false;
+    DeviceConfig* _deviceConfig = NULL;
+    uint16_t _deviceConfigValidFields = 0;
+    uint16_t _provisionedSettings = 0;
+    bool _provisionSkipped = false;
+    bool _provisionFingerprintEnabled = false;
+    uint16_t _provisionFingerprintAddress = 0;
     uint8_t* _contentBuffer = NULL;
+    uint16_t _contentBufferSize = 0;
+    uint16_t _allocationCount = 0;
+    uint8_t _receiveBufferCount = DEFAULT_RECEIVE_BUFFER_COUNT;
+    uint8_t* _receiveBuffers[MAX_RECEIVE_BUFFER_COUNT] = {};
+    uint8_t _receiveBufferRetainCounts[MAX_RECEIVE_BUFFER_COUNT] = {};
+    uint8_t _receiveBufferIndex = 0;
+    bool _discardingFrame = false;
+    uint32_t _droppedFrameCount = 0;
+    bool _deferredDispatchEnabled = false;
+    ReceivedFrame* _receivedFrameQueue = NULL;
+    uint8_t _receivedFrameQueueHead = 0;
+    uint8_t _receivedFrameQueueCount = 0;
+    unsigned long _slowHandlerThreshold = DEFAULT_SLOW_HANDLER_THRESHOLD;
+    HandlerMetrics _messageHandlerMetrics = {};
+    HandlerMetrics _eventHandlerMetrics = {};
+    uint8_t* _printBuffer = NULL;
 
     Role _role;
     char* _remoteAddress = NULL;
@@ -228,7 +730,17 @@ private:
     volatile long _transmissionTimerStoppedTimestamp = 0;
     int8_t _disconnectReconnectInputPin = -1;
     bool _autoReconnectEnabled = false;
+    bool _warmStartEnabled = false;
+    bool _warmStartAcknowledged = false;
+    unsigned long _warmStartNonce = 0;
     long _autoReconnectTimeout = 30000;
+    bool _reconnectBackoffEnabled = false;
+    unsigned long _reconnectInitialDelay = 0;
+    unsigned long _reconnectMaxDelay = 0;
+    unsigned long _reconnectDelay = 0;
+    long _reconnectJitter = 0;
+    uint8_t _reconnectJitterPercent = DEFAULT_RECONNECT_JITTER;
+    ReconnectStats _reconnectStats = {};
     bool _consoleModeEnabled = false;
     Stream* _stream;
     BaudRate _baudRate = BaudRate::Baud_Default;
@@ -239,7 +751,19 @@ private:
     bool _manuallyDisconnected = false;
     long _lastConnectAttemptTimestamp = 0;
     uint8_t _prefixCursor = 0;
+    uint8_t _headerCursor = 0;
     uint16_t _contentCursor = 0;
+    uint16_t _chunkCursor = 0;
+    uint16_t _contentOffset = 0;
+    bool _moreFragments = false;
+    bool _continuationFragment = false;
+    bool _assembling = false;
+    bool _assemblyIsEvent = false;
+    uint16_t _assemblyID = 0;
+    uint16_t _assemblyLength = 0;
+    uint8_t _assemblyBufferIndex = 0;
+    bool _streamingReceiveEnabled = false;
+    bool _streamingFrame = false;
     bool _messageSuspected = false;
     bool _messageDetected = false;
     bool _eventSuspected = false;
@@ -250,6 +774,55 @@ private:
     byte _lengthHighByte = 0;
     byte _lengthLowByte = 0;
     uint16_t _contentLength = 0;
+    uint8_t* _lowPriorityQueueBuffer = NULL;
+    uint16_t _lowPriorityQueueHead = 0;
+    uint16_t _lowPriorityQueueUsed = 0;
+    uint16_t _lowPriorityQueueSentOffset = 0;
+    uint8_t* _offlineQueueBuffer = NULL;
+    bool _offlineQueueEnabled = false;
+    OfflineQueuePolicy _offlineQueuePolicy = OfflineQueuePolicy::DropOldest;
+    uint16_t _offlineQueueEepromAddress = 0;
+    uint16_t _offlineQueueEepromSize = 0;
+    uint16_t _offlineQueueHead = 0;
+    uint16_t _offlineQueueUsed = 0;
+    uint16_t _offlineQueueItemCount = 0;
+    uint32_t _offlineQueueDroppedCount = 0;
+    uint16_t _offlineQueueSentOffset = 0;
+    Channel* _channels = NULL;
+    uint8_t _lastServicedChannel = MAX_CHANNELS - 1;
+    RpcState* _rpc = NULL;
+    BlobState* _blob = NULL;
+    unsigned long _pingInterval = 0;
+    unsigned long _lastPingTime = 0;
+    RoundTripState* _roundTrip = NULL;
+    unsigned long _clockSyncInterval = 0;
+    unsigned long _lastClockSyncRequestTime = 0;
+    ClockState* _clock = NULL;
+    bool _frameTimestampsEnabled = false;
+    bool _frameTimestamped = false;
+    unsigned long _frameTimestamp = 0;
+    unsigned long _receivedFrameTimestamp = 0;
+    unsigned long _heartbeatInterval = 0;
+    unsigned long _lastHeartbeatTime = 0;
+    unsigned long _lastReceiveTime = 0;
+    uint8_t _heartbeatMissLimit = DEFAULT_HEARTBEAT_MISS_LIMIT;
+    uint8_t _heartbeatMisses = 0;
+    uint16_t _heartbeatTimeoutCount = 0;
+    uint8_t _notificationCursor = 0;
+    bool _lostNotificationSuspected = false;
+    bool _lostNotificationPending = false;
+    bool _connectNotificationPending = false;
+    unsigned long _connectNotificationTimestamp = 0;
+    bool _moduleConnected = false;
+    bool _statePinInterruptEnabled = false;
+    volatile bool _statePinHigh = false;
+    volatile unsigned long _statePinChangeTimestamp = 0;
+    unsigned long _connectionStateChangeTimestamp = 0;
+    SendLatencyMetrics _highPrioritySendMetrics = {};
+    SendLatencyMetrics _lowPrioritySendMetrics = {};
+    bool _printingMessage = false;
+    bool _printFailed = false;
+    uint16_t _printCursor = 0;
 
     ConnectedDelegate _connectedHandler = NULL;
     DisconnectedDelegate _disconnectedHandler = NULL;
@@ -257,8 +830,90 @@ private:
     EventReceivedCharDelegate _eventReceivedCharHandler = NULL;
     MessageReceivedUInt8Delegate _messageReceivedUInt8Handler = NULL;
     MessageReceivedCharDelegate _messageReceivedCharHandler = NULL;
+    FrameStartDelegate _frameStartHandler = NULL;
+    FrameChunkDelegate _frameChunkHandler = NULL;
+    FrameEndDelegate _frameEndHandler = NULL;
+    ChannelReceivedDelegate _channelReceivedHandler = NULL;
+    BlobWriteDelegate _blobWriteHandler = NULL;
+    BlobProgressDelegate _blobProgressHandler = NULL;
+    BlobCompletedDelegate _blobCompletedHandler = NULL;
+    PingDelegate _pingHandler = NULL;
+
+
+};
+
+
+template <uint16_t RxSize = BondedHM10::DEFAULT_MAX_CONTENT_LENGTH, uint16_t TxSize = BondedHM10::DEFAULT_PRINT_BUFFER_SIZE, uint16_t OfflineQueueSize = BondedHM10::DEFAULT_OFFLINE_QUEUE_SIZE, uint16_t ChannelQueueSize = BondedHM10::DEFAULT_CHANNEL_QUEUE_SIZE, uint8_t RxBufferCount = BondedHM10::DEFAULT_RECEIVE_BUFFER_COUNT, typename StreamType = Stream>
+class BondedHM10T: public BondedHM10
+{
+    // RxSize is the largest message/event content that can be received (and sent, as the remote is expected to use
+    // the same size). TxSize is the size of each message printed between beginMessage() and endMessage(). An
+    // OfflineQueueSize or ChannelQueueSize of 0 leaves the offline queue or channels out altogether. RxBufferCount is
+    // the number of receive buffers, one of which is always kept free for incoming frames.
+    // With StreamType set to the concrete stream (e.g. HardwareSerial), incoming bytes are read through direct
+    // rather than virtual calls. Outgoing bytes are still written through Stream's virtual write().
+    static_assert(RxSize > 0 && RxSize <= 0x1FFF, "RxSize must fit in a frame's length field.");
+    static_assert(TxSize > 0 && TxSize <= RxSize, "TxSize must be between 1 and RxSize.");
+    static_assert(RxBufferCount >= 2 && RxBufferCount <= MAX_RECEIVE_BUFFER_COUNT, "RxBufferCount must be between 2 and MAX_RECEIVE_BUFFER_COUNT.");
 
+public:
+
+    BondedHM10T(const Role role, const char* remoteAddress, const byte statePin, const byte resetPin)
+        : BondedHM10(role, remoteAddress, statePin, resetPin, RxSize, RxBufferCount, &_receiveStorage[0][0], _receivedFrameStorage, _printStorage, TxSize, _lowPriorityQueueStorage,
+                     (OfflineQueueSize > 0 ? _offlineQueueStorage : NULL), OfflineQueueSize,
+                     (ChannelQueueSize > 0 ? _channelStateStorage : NULL), (ChannelQueueSize > 0 ? &_channelStorage[0][0] : NULL), ChannelQueueSize, &_featureStorage)
+    {
+    }
+
+    bool begin(StreamType& stream, bool autoConnect = true)
+    {
+        return BondedHM10::begin(stream, autoConnect);
+    }
+
+    void loop(uint16_t maxBytesToRead = DEFAULT_MAX_BYTES_TO_READ)
+    {
+        if (!isReceivingFrames())
+        {
+            BondedHM10::loop(maxBytesToRead);
+            return;
+        }
+
+        serviceConnection();
+
+        StreamType& stream = static_cast<StreamType&>(*getStream());
+        byte bytes[MAX_BYTES_READ_PER_LOOP];
+        int available = availableBytes(stream);
+        uint16_t count = min(available, (int)MAX_BYTES_READ_PER_LOOP);
+
+        for (uint16_t i = 0; i < count; i++)
+        {
+            bytes[i] = (byte)readByte(stream);
+        }
+
+        receiveBytes(bytes, count);
+        serviceLink();
+    }
+
+private:
 
+    // Qualified calls are bound at compile time (and can be inlined), unlike calls through a Stream reference. The
+    // Stream overloads keep the default StreamType working, where the calls have to stay virtual.
+    template <typename S>
+    static int availableBytes(S& stream) { return stream.S::available(); }
+    static int availableBytes(Stream& stream) { return stream.available(); }
+
+    template <typename S>
+    static int readByte(S& stream) { return stream.S::read(); }
+    static int readByte(Stream& stream) { return stream.read(); }
+
+    uint8_t _receiveStorage[RxBufferCount][RxSize + 1];
+    ReceivedFrame _receivedFrameStorage[RxBufferCount];
+    uint8_t _printStorage[TxSize];
+    uint8_t _lowPriorityQueueStorage[RxSize + QUEUE_ITEM_HEADER_SIZE];
+    uint8_t _offlineQueueStorage[OfflineQueueSize > 0 ? OfflineQueueSize : 1];
+    uint8_t _channelStorage[MAX_CHANNELS][ChannelQueueSize > 0 ? ChannelQueueSize : 1];
+    Channel _channelStateStorage[ChannelQueueSize > 0 ? MAX_CHANNELS : 1];
+    FeatureState _featureStorage;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,312 @@
+/*
+ * Host test for the heap use of BondedHM10: once every feature has been used for the first time, nothing the
+ * library does may allocate again. A central and a peripheral are wired up to a pair of simulated HM-10 modules
+ * and taken through begin, provisioning, the configuration getters and setters, connecting, traffic and
+ * reconnecting, over and over, while the allocation count must not move.
+ *
+ * Build and run from the root of the library (no Arduino installation needed):
+ *
+ *   g++ -std=gnu++11 -I extras/test extras/test/AllocationTest.cpp -o AllocationTest && ./AllocationTest
+ */
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include "../../BondedHM10.cpp"
+
+const int ROUNDS = 20;
+const byte CENTRAL_STATE_PIN = 4;
+const byte CENTRAL_RESET_PIN = 5;
+const byte PERIPHERAL_STATE_PIN = 14;
+const byte PERIPHERAL_RESET_PIN = 15;
+const char CENTRAL_ADDRESS[] = "A1B2C3D4E5F6";
+const char PERIPHERAL_ADDRESS[] = "112233445566";
+
+// Answers AT commands the way an HM-10 does while there's no link, and passes everything through to the other
+// module once there is one.
+class MockHM10 : public Stream
+{
+public:
+  MockHM10(const char *address, const byte statePin) : _address(address), _statePin(statePin)
+  {
+    _settings["ROLE"] = "0";
+    _settings["BAUD"] = "0";
+    _settings["IMME"] = "0";
+    _settings["ALLO"] = "0";
+    _settings["NOTI"] = "0";
+    _settings["TYPE"] = "0";
+    _settings["AFTC"] = "000";
+    _settings["NAME"] = "HMSoft";
+    _settings["AD1"] = "000000000000";
+    _settings["AD2"] = "000000000000";
+    _settings["AD3"] = "000000000000";
+    _settings["RADD"] = "000000000000";
+  }
+
+  void pair(MockHM10 &remote) { _remote = &remote; }
+
+  void link(const bool linked)
+  {
+    _linked = _remote->_linked = linked;
+    hostPins[_statePin] = hostPins[_remote->_statePin] = (linked ? HIGH : LOW);
+
+    if (linked)
+    {
+      _settings["RADD"] = _remote->_address;
+    }
+  }
+
+  int available() { return (int)_input.size(); }
+
+  int read()
+  {
+    if (_input.empty())
+    {
+      return -1;
+    }
+
+    int c = _input.front();
+    _input.pop_front();
+
+    return c;
+  }
+
+  int peek() { return (_input.empty() ? -1 : _input.front()); }
+
+  size_t write(uint8_t c)
+  {
+    if (_linked)
+    {
+      _remote->_input.push_back(c);
+    }
+    else
+    {
+      _command += (char)c;
+    }
+
+    return 1;
+  }
+
+  using Print::write;
+
+  int availableForWrite() { return 64; }
+
+  // The library flushes after every AT command, which is when the module answers it.
+  void flush()
+  {
+    if (_linked || _command.empty())
+    {
+      return;
+    }
+
+    std::string command = _command;
+    _command.clear();
+
+    if (command == "AT")
+    {
+      reply("OK");
+    }
+    else if (command == "AT+START")
+    {
+      reply("OK+START");
+
+      if (_settings["RADD"] == _remote->_address)
+      {
+        link(true);
+      }
+    }
+    else if (command == "AT+CLEAR")
+    {
+      _settings["RADD"] = "000000000000";
+      reply("OK+CLEAR");
+    }
+    else if (command.compare(0, 6, "AT+CON") == 0)
+    {
+      reply("OK+CONNA");
+
+      if (command.substr(6) == _remote->_address)
+      {
+        link(true);
+      }
+    }
+    else if (command == "AT+ADDR?")
+    {
+      reply("OK+ADDR:" + _address);
+    }
+    else if (command == "AT+NAME?" || command == "AT+RADD?")
+    {
+      reply("OK+" + command.substr(3, 4) + ":" + _settings[command.substr(3, 4)]);
+    }
+    else if (command == "AT+VERR?")
+    {
+      reply("HMSoft V610");
+    }
+    else if (command.compare(0, 5, "AT+AD") == 0)
+    {
+      std::string slot = command.substr(3, 3);
+      std::string value = command.substr(6);
+
+      if (value == "??")
+      {
+        reply("OK+" + slot + "?:" + _settings[slot]);
+      }
+      else
+      {
+        _settings[slot] = value;
+        reply("OK+" + slot + value);
+      }
+    }
+    else
+    {
+      std::string key = command.substr(3, 4);
+      std::string value = command.substr(7);
+
+      if (value == "?")
+      {
+        reply("OK+Get:" + _settings[key]);
+      }
+      else
+      {
+        _settings[key] = value;
+        reply("OK+Set:" + value);
+      }
+    }
+  }
+
+private:
+  void reply(const std::string &response) { _input.insert(_input.end(), response.begin(), response.end()); }
+
+  std::string _address;
+  byte _statePin;
+  MockHM10 *_remote = NULL;
+  bool _linked = false;
+  std::map<std::string, std::string> _settings;
+  std::deque<uint8_t> _input;
+  std::string _command;
+};
+
+static uint16_t messagesReceived = 0;
+static uint16_t eventsReceived = 0;
+static uint16_t channelFramesReceived = 0;
+static uint16_t rpcRepliesReceived = 0;
+
+void onMessage(const uint8_t *content, const uint16_t length) { messagesReceived++; }
+void onEvent(const uint16_t id, const uint8_t *content, const uint16_t length) { eventsReceived++; }
+void onChannel(const uint8_t channel, const uint8_t *content, const uint16_t length) { channelFramesReceived++; }
+void onRpcCompleted(const uint8_t callID, const BondedHM10::RpcStatus status, const uint8_t *content, const uint16_t length) { rpcRepliesReceived++; }
+
+BondedHM10 *echoServer = NULL;
+
+void onEchoRequest(const uint8_t method, const uint8_t callID, const uint8_t *content, const uint16_t length)
+{
+  echoServer->replyRpc(callID, content, length);
+}
+
+void run(BondedHM10 &central, BondedHM10 &peripheral, const int passes)
+{
+  for (int i = 0; i < passes; i++)
+  {
+    central.loop();
+    peripheral.loop();
+  }
+}
+
+void check(const bool condition, const char *what, const int round)
+{
+  if (!condition)
+  {
+    printf("FAIL: %s (round %d)\n", what, round);
+    exit(1);
+  }
+}
+
+int main()
+{
+  MockHM10 centralModule(CENTRAL_ADDRESS, CENTRAL_STATE_PIN);
+  MockHM10 peripheralModule(PERIPHERAL_ADDRESS, PERIPHERAL_STATE_PIN);
+  BondedHM10 central(BondedHM10::Role::Central, PERIPHERAL_ADDRESS, CENTRAL_STATE_PIN, CENTRAL_RESET_PIN);
+  BondedHM10 peripheral(BondedHM10::Role::Peripheral, CENTRAL_ADDRESS, PERIPHERAL_STATE_PIN, PERIPHERAL_RESET_PIN);
+  uint16_t baseline = 0;
+
+  centralModule.pair(peripheralModule);
+  peripheralModule.pair(centralModule);
+  echoServer = &peripheral;
+
+  central.setMessageReceivedHandler(onMessage);
+  peripheral.setMessageReceivedHandler(onMessage);
+  peripheral.setEventReceivedHandler(onEvent);
+  peripheral.setChannelReceivedHandler(onChannel);
+  central.setOfflineQueueEnabled(true);
+
+  for (int round = 1; round <= ROUNDS; round++)
+  {
+    char text[32];
+    BondedHM10::DeviceConfig config;
+    uint8_t blob[BondedHM10::CONFIG_BLOB_SIZE];
+
+    check(central.begin(centralModule, false), "central begin", round);
+    check(peripheral.begin(peripheralModule, false), "peripheral begin", round);
+    central.setAutoReconnectEnabled(true);
+    check(central.provision(BondedHM10::BaudRate::Baud_Default), "central provision", round);
+    check(peripheral.provision(BondedHM10::BaudRate::Baud_Default), "peripheral provision", round);
+
+    central.invalidateDeviceConfig();
+    check(central.getDeviceConfig(config), "getDeviceConfig", round);
+    check(central.getAddress(text) && strcmp(text, CENTRAL_ADDRESS) == 0, "getAddress", round);
+    check(central.getFirmwareVersion(text), "getFirmwareVersion", round);
+    check(central.setDeviceName("Central"), "setDeviceName", round);
+    check(central.getDeviceName(text), "getDeviceName", round);
+    check(central.saveConfig(blob) && central.restoreConfig(blob), "saveConfig/restoreConfig", round);
+
+    messagesReceived = eventsReceived = channelFramesReceived = rpcRepliesReceived = 0;
+
+    // Written while there's no link yet, so it waits in the offline queue.
+    check(central.writeMessage("queued while offline"), "offline writeMessage", round);
+
+    check(central.connectToPeripheral(), "connectToPeripheral", round);
+    run(central, peripheral, 50);
+    check(central.isConnected() && peripheral.isConnected(), "connected", round);
+
+    if (round == 1)
+    {
+      check(peripheral.registerRpcMethod(1, onEchoRequest), "registerRpcMethod", round);
+      check(peripheral.openChannel(0, 4) && central.openChannel(0, 4), "openChannel", round);
+    }
+
+    check(central.writeMessage("hello"), "writeMessage", round);
+    check(peripheral.writeMessage("hello back"), "writeMessage back", round);
+    check(central.writeEvent(1, "event"), "writeEvent", round);
+    check(central.writeChannel(0, "channel"), "writeChannel", round);
+    check(central.callRpc(1, "echo", onRpcCompleted) != 0, "callRpc", round);
+    check(central.ping(), "ping", round);
+    check(central.beginMessage(), "beginMessage", round);
+    central.print(F("printed "));
+    central.println(round);
+    check(central.endMessage(), "endMessage", round);
+    run(central, peripheral, 200);
+
+    check(messagesReceived == 4 && eventsReceived == 1 && channelFramesReceived == 1 && rpcRepliesReceived == 1, "traffic delivered", round);
+
+    // The link drops, and the central has to bring it back up by itself.
+    centralModule.link(false);
+    run(central, peripheral, 20000);
+    check(central.isConnected() && peripheral.isConnected(), "reconnected", round);
+
+    // Dropped for good this time, so the next round starts from scratch.
+    central.setAutoReconnectEnabled(false);
+    centralModule.link(false);
+    run(central, peripheral, 50);
+
+    if (round == 1)
+    {
+      baseline = central.getAllocationCount() + peripheral.getAllocationCount();
+    }
+
+    check(central.getAllocationCount() + peripheral.getAllocationCount() == baseline, "allocation count unchanged", round);
+  }
+
+  printf("PASS: %u allocations, none after the first round\n", baseline);
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * A minimal stand-in for the Arduino core, just enough to build BondedHM10 on a PC for the host tests in this
+ * folder. Time only moves forward when it is asked for (every millis() call is a millisecond later), so the
+ * library's busy-wait loops always come to an end. Pins are plain variables the tests can set.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define strcpy_P strcpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bit(b) (1UL << (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+inline uint16_t word(const uint8_t high, const uint8_t low) { return (uint16_t)((high << 8) | low); }
+
+
+static unsigned long hostMillis = 0;
+static int hostPins[64] = {};
+
+inline unsigned long millis() { return ++hostMillis; }
+inline unsigned long micros() { return hostMillis * 1000; }
+inline void delay(const unsigned long ms) { hostMillis += ms; }
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline int digitalRead(const uint8_t pin) { return hostPins[pin]; }
+inline void digitalWrite(const uint8_t pin, const uint8_t value) { hostPins[pin] = value; }
+inline int digitalPinToInterrupt(const int pin) { return pin; }
+inline void attachInterrupt(int, void (*)(void), int) {}
+inline void detachInterrupt(int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+inline long random(const long high) { return (high > 0 ? rand() % high : 0); }
+inline long random(const long low, const long high) { return (high > low ? low + rand() % (high - low) : low); }
+inline void randomSeed(const unsigned long seed) { srand((unsigned int)seed); }
+
+static volatile uint8_t OCR0A, TIMSK0;
+#define OCIE0A 1
+#define ISR(vector) extern "C" void vector(void)
+
+
+class Print
+{
+public:
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t count = 0;
+
+        while (size--)
+        {
+            count += write(*buffer++);
+        }
+
+        return count;
+    }
+    size_t write(const char *str) { return (str == NULL ? 0 : write((const uint8_t *)str, strlen(str))); }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const __FlashStringHelper *str) { return write((const char *)str); }
+    size_t print(const char *str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char value, int = DEC) { return printFormatted("%u", (unsigned int)value); }
+    size_t print(int value, int = DEC) { return printFormatted("%d", value); }
+    size_t print(unsigned int value, int = DEC) { return printFormatted("%u", value); }
+    size_t print(long value, int = DEC) { return printFormatted("%ld", value); }
+    size_t print(unsigned long value, int = DEC) { return printFormatted("%lu", value); }
+    size_t print(double value, int digits = 2) { return printFormatted("%.*f", digits, value); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(T value) { return print(value) + println(); }
+    template <typename T> size_t println(T value, int format) { return print(value, format) + println(); }
+
+private:
+    template <typename... Args> size_t printFormatted(const char *format, Args... args)
+    {
+        char buffer[32];
+        int length = snprintf(buffer, sizeof(buffer), format, args...);
+
+        return write((const uint8_t *)buffer, (size_t)length);
+    }
+};
+
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(char *buffer, size_t length)
+    {
+        size_t count = 0;
+
+        while (count < length && available())
+        {
+            buffer[count++] = (char)read();
+        }
+
+        return count;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+};
+
+
+class HardwareSerial : public Stream
+{
+public:
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t c) { return (size_t)putchar(c); }
+    using Print::write;
+    void begin(long) {}
+    operator bool() { return true; }
+};
+
+static HardwareSerial Serial;
+
+
+class EEPROMClass
+{
+public:
+    uint8_t read(const int address) { return _data[address]; }
+    void write(const int address, const uint8_t value) { _data[address] = value; }
+    void update(const int address, const uint8_t value) { _data[address] = value; }
+    uint16_t length() { return sizeof(_data); }
+    template <typename T> T &get(const int address, T &value) { memcpy(&value, _data + address, sizeof(T)); return value; }
+    template <typename T> const T &put(const int address, const T &value) { memcpy(_data + address, &value, sizeof(T)); return value; }
+
+private:
+    uint8_t _data[1024] = {};
+};
+
+static EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,2 @@
+// Part of the host stand-in for the Arduino core, see Arduino.h.
+#include "Arduino.h"
@@ -0,0 +1,126 @@
+/*
+ * Host benchmark for the receive path: how long loop() takes per incoming byte when the stream is read through
+ * virtual Stream calls (BondedHM10) and through direct calls to the concrete stream type (BondedHM10T with its
+ * StreamType parameter set). Both parse the same 200 byte message frames.
+ *
+ * Build and run from the root of the library (no Arduino installation needed):
+ *
+ *   g++ -std=gnu++11 -O2 -I extras/test extras/test/ReadBenchmark.cpp -o ReadBenchmark && ./ReadBenchmark [frames]
+ */
+
+#include <chrono>
+#include <vector>
+
+#include "../../BondedHM10.cpp"
+
+const uint16_t CONTENT_LENGTH = 200;
+const int DEFAULT_FRAMES = 5000;
+const int RUNS = 3;
+const byte STATE_PIN = 4;
+const byte RESET_PIN = 5;
+
+// Hands out a prerecorded byte stream, and throws away whatever is written to it.
+class ByteSource : public Stream
+{
+public:
+  void load(const std::vector<uint8_t> &bytes)
+  {
+    _bytes = bytes;
+    _position = 0;
+  }
+
+  int available() { return (int)(_bytes.size() - _position); }
+  int read() { return (_position < _bytes.size() ? _bytes[_position++] : -1); }
+  int peek() { return (_position < _bytes.size() ? _bytes[_position] : -1); }
+  size_t write(uint8_t) { return 1; }
+  using Print::write;
+
+private:
+  std::vector<uint8_t> _bytes;
+  size_t _position = 0;
+};
+
+typedef BondedHM10T<BondedHM10::DEFAULT_MAX_CONTENT_LENGTH, BondedHM10::DEFAULT_PRINT_BUFFER_SIZE, BondedHM10::DEFAULT_OFFLINE_QUEUE_SIZE, BondedHM10::DEFAULT_CHANNEL_QUEUE_SIZE, BondedHM10::DEFAULT_RECEIVE_BUFFER_COUNT, ByteSource> DirectBondedHM10;
+
+static unsigned long contentReceived = 0;
+
+void onMessage(const uint8_t *content, const uint16_t length) { contentReceived += length; }
+
+std::vector<uint8_t> makeFrames(const int frames)
+{
+  std::vector<uint8_t> bytes;
+
+  for (int i = 0; i < frames; i++)
+  {
+    const char prefix[] = "~MSG";
+
+    bytes.insert(bytes.end(), prefix, prefix + 4);
+    bytes.push_back(lowByte(CONTENT_LENGTH));
+    bytes.push_back(highByte(CONTENT_LENGTH));
+    bytes.insert(bytes.end(), CONTENT_LENGTH, 'z');
+  }
+
+  return bytes;
+}
+
+// Brings the device up as a connected peripheral, which is all the receive path needs.
+template <typename Device>
+void connect(Device &device, ByteSource &source)
+{
+  hostPins[STATE_PIN] = LOW;
+  device.begin(source, false);
+  device.setMessageReceivedHandler(onMessage);
+  hostPins[STATE_PIN] = HIGH;
+  device.loop();
+}
+
+template <typename Device>
+double measure(Device &device, ByteSource &source, const std::vector<uint8_t> &bytes)
+{
+  source.load(bytes);
+  contentReceived = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  while (source.available() > 0)
+  {
+    device.loop();
+  }
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  if (contentReceived != (unsigned long)CONTENT_LENGTH * (bytes.size() / (CONTENT_LENGTH + 6)))
+  {
+    printf("FAIL: only %lu content bytes were received\n", contentReceived);
+    exit(1);
+  }
+
+  return std::chrono::duration<double, std::nano>(end - start).count() / bytes.size();
+}
+
+int main(int argc, char **argv)
+{
+  int frames = (argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES);
+  std::vector<uint8_t> bytes = makeFrames(frames);
+  ByteSource virtualSource;
+  ByteSource directSource;
+  BondedHM10 virtualDevice(BondedHM10::Role::Peripheral, "112233445566", STATE_PIN, RESET_PIN);
+  DirectBondedHM10 directDevice(BondedHM10::Role::Peripheral, "112233445566", STATE_PIN, RESET_PIN);
+  double virtualTime = 0;
+  double directTime = 0;
+
+  connect(virtualDevice, virtualSource);
+  connect(directDevice, directSource);
+
+  for (int run = 0; run < RUNS; run++)
+  {
+    virtualTime += measure(virtualDevice, virtualSource, bytes);
+    directTime += measure(directDevice, directSource, bytes);
+  }
+
+  printf("%d x %u byte messages, average of %d runs\n", frames, CONTENT_LENGTH, RUNS);
+  printf("BondedHM10 (virtual Stream calls):  %.2f ns/byte\n", virtualTime / RUNS);
+  printf("BondedHM10T<..., ByteSource>:       %.2f ns/byte\n", directTime / RUNS);
+
+  return 0;
+}